@@ -0,0 +1,22 @@
+// This is an auto-generated file.  DO NOT EDIT!
+// Generated with "./tools/gen-offsets.sh out/asm-offsets.s out/asm-offsets.h"
+#ifndef __ASM_OFFSETS_H
+#define __ASM_OFFSETS_H
+/* BREGS */
+#define BREGS_es 2 /* offsetof(struct bregs, es) */
+#define BREGS_ds 0 /* offsetof(struct bregs, ds) */
+#define BREGS_eax 28 /* offsetof(struct bregs, eax) */
+#define BREGS_ebx 16 /* offsetof(struct bregs, ebx) */
+#define BREGS_ecx 24 /* offsetof(struct bregs, ecx) */
+#define BREGS_edx 20 /* offsetof(struct bregs, edx) */
+#define BREGS_ebp 12 /* offsetof(struct bregs, ebp) */
+#define BREGS_esi 8 /* offsetof(struct bregs, esi) */
+#define BREGS_edi 4 /* offsetof(struct bregs, edi) */
+#define BREGS_flags 36 /* offsetof(struct bregs, flags) */
+#define BREGS_code 32 /* offsetof(struct bregs, code) */
+/* BDA */
+#define BDA_ebda_seg 14 /* offsetof(struct bios_data_area_s, ebda_seg) */
+/* EBDA */
+#define EBDA_OFFSET_TOP_STACK 872 /* EBDA_OFFSET_TOP_STACK */
+#define EBDA_SEGMENT_START 40896 /* EBDA_SEGMENT_START */
+#endif // asm-offsets.h
@@ -0,0 +1,64 @@
+/*
+ * Automatically generated C config: don't edit
+ * SeaBIOS Configuration
+ * Mon Oct 19 07:46:53 2026
+ */
+#define CONFIG_BOOTSPLASH 1
+#define CONFIG_SMBIOS 1
+#define CONFIG_RELOCATE_INIT 1
+#define CONFIG_USB_UHCI 1
+#define CONFIG_LZ4 0
+#define CONFIG_USB_EHCI 1
+#define CONFIG_USB 1
+#define CONFIG_VGAHOOKS 0
+#define CONFIG_SCRUB_RAM 0
+#define CONFIG_ATA 1
+#define CONFIG_ATA_DMA 0
+#define CONFIG_MOUSE 1
+#define CONFIG_OPTIONROM_CACHE 0
+#define CONFIG_ACPI 1
+#define CONFIG_THREAD_OPTIONROMS 0
+#define CONFIG_XEN 0
+#define CONFIG_FLASH_CACHE 0
+#define CONFIG_ATA_PIO32 0
+#define CONFIG_THREADS 1
+#define CONFIG_BOOT 1
+#define CONFIG_DEBUG_SERIAL_PORT 0
+#define CONFIG_PMM 1
+#define CONFIG_LPT 1
+#define CONFIG_COREBOOT_FLASH 0
+#define CONFIG_PIRTABLE 1
+#define CONFIG_DISABLE_A20 0
+#define CONFIG_OPTIONROMS_DEPLOYED 0
+#define CONFIG_PNPBIOS 1
+#define CONFIG_OPTIONROMS 1
+#define CONFIG_DEBUG_MEMBENCH 0
+#define CONFIG_FLASH_FLOPPY 0
+#define CONFIG_KEYBOARD 1
+#define CONFIG_KBD_CALL_INT15_4F 1
+#define CONFIG_FASTBOOT 0
+#define CONFIG_DRIVES 1
+#define CONFIG_BOOTORDER 1
+#define CONFIG_DEBUG_SERIAL 0
+#define CONFIG_PS2PORT 1
+#define CONFIG_SERIAL 1
+#define CONFIG_MTRR_INIT 1
+#define CONFIG_USB_KEYBOARD 1
+#define CONFIG_DEBUG_LEVEL 1
+#define CONFIG_AHCI 1
+#define CONFIG_S3_RESUME 1
+#define CONFIG_FLOPPY 1
+#define CONFIG_USB_HUB 1
+#define CONFIG_USB_MSC 1
+#define CONFIG_PCIBIOS 1
+#define CONFIG_CDROM_BOOT 1
+#define CONFIG_USB_MOUSE 1
+#define CONFIG_BOOTMENU 1
+#define CONFIG_MPTABLE 1
+#define CONFIG_COREBOOT 0
+#define CONFIG_CDROM_EMU 1
+#define CONFIG_USB_OHCI 1
+#define CONFIG_LZMA 0
+#define CONFIG_VIRTIO_BLK 1
+#define CONFIG_USE_SMM 1
+#define CONFIG_APMBIOS 1
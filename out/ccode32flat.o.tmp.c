@@ -0,0 +1,57 @@
+#include "../src/misc.c"
+ #include "../src/pmm.c"
+ #include "../src/stacks.c"
+ #include "../src/output.c"
+ #include "../src/util.c"
+ #include "../src/block.c"
+ #include "../src/floppy.c"
+ #include "../src/ata.c"
+ #include "../src/mouse.c"
+ #include "../src/kbd.c"
+ #include "../src/pci.c"
+ #include "../src/serial.c"
+ #include "../src/clock.c"
+ #include "../src/pic.c"
+ #include "../src/cdrom.c"
+ #include "../src/ps2port.c"
+ #include "../src/smp.c"
+ #include "../src/resume.c"
+ #include "../src/pnpbios.c"
+ #include "../src/pirtable.c"
+ #include "../src/vgahooks.c"
+ #include "../src/ramdisk.c"
+ #include "../src/pcibios.c"
+ #include "../src/blockcmd.c"
+ #include "../src/usb.c"
+ #include "../src/usb-uhci.c"
+ #include "../src/usb-ohci.c"
+ #include "../src/usb-ehci.c"
+ #include "../src/usb-hid.c"
+ #include "../src/usb-msc.c"
+ #include "../src/virtio-ring.c"
+ #include "../src/virtio-pci.c"
+ #include "../src/virtio-blk.c"
+ #include "../src/apm.c"
+ #include "../src/ahci.c"
+ #include "../src/post.c"
+ #include "../src/shadow.c"
+ #include "../src/memmap.c"
+ #include "../src/coreboot.c"
+ #include "../src/boot.c"
+ #include "../src/acpi.c"
+ #include "../src/smm.c"
+ #include "../src/mptable.c"
+ #include "../src/smbios.c"
+ #include "../src/pciinit.c"
+ #include "../src/optionroms.c"
+ #include "../src/mtrr.c"
+ #include "../src/lzmadecode.c"
+ #include "../src/lz4decode.c"
+ #include "../src/bootsplash.c"
+ #include "../src/jpeg.c"
+ #include "../src/usb-hub.c"
+ #include "../src/paravirt.c"
+ #include "../src/biostables.c"
+ #include "../src/xen.c"
+ #include "../src/bmp.c"
+ #include "../src/xen-xs.c"
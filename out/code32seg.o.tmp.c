@@ -0,0 +1,6 @@
+#include "../src/util.c"
+ #include "../src/output.c"
+ #include "../src/pci.c"
+ #include "../src/pcibios.c"
+ #include "../src/apm.c"
+ #include "../src/stacks.c"
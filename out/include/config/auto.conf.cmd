@@ -0,0 +1,8 @@
+deps_config := \
+	/root/repo/src/Kconfig
+
+include/config/auto.conf: \
+	$(deps_config)
+
+
+$(deps_config): ;
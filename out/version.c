@@ -0,0 +1 @@
+const char VERSION[] = "pre-0.6.3-20261019_062812-vm";
@@ -0,0 +1,8 @@
+#include "../src/output.c"
+ #include "../src/util.c"
+ #include "../vgasrc/vga.c"
+ #include "../vgasrc/vgafb.c"
+ #include "../vgasrc/vgaio.c"
+ #include "../vgasrc/vgatables.c"
+ #include "../vgasrc/vgafonts.c"
+ #include "../vgasrc/clext.c"
@@ -89,7 +89,11 @@ struct multiple_apic_table
 #define APIC_IO_SAPIC           6
 #define APIC_LOCAL_SAPIC        7
 #define APIC_XRUPT_SOURCE       8
-#define APIC_RESERVED           9           /* 9 and greater are reserved */
+#define APIC_LOCAL_X2APIC       9
+#define APIC_RESERVED           10          /* 10 and greater are reserved */
+
+/* Largest apic id that can be described with an 8-bit MADT entry */
+#define MAX_XAPIC_ID            0xfe
 
 /*
  * MADT sub-structures (Follow MULTIPLE_APIC_DESCRIPTION_TABLE)
@@ -113,6 +117,15 @@ struct madt_processor_apic
 #endif
 } PACKED;
 
+struct madt_local_x2apic
+{
+    ACPI_SUB_HEADER_DEF
+    u16 reserved;
+    u32 x2apic_id;              /* Processor's local x2APIC id */
+    u32 flags;
+    u32 uid;                    /* ACPI processor uid */
+} PACKED;
+
 struct madt_io_apic
 {
     ACPI_SUB_HEADER_DEF
@@ -164,6 +177,7 @@ struct acpi_20_hpet {
 
 #define SRAT_PROCESSOR          0
 #define SRAT_MEMORY             1
+#define SRAT_X2APIC             2
 
 struct system_resource_affinity_table
 {
@@ -195,6 +209,34 @@ struct srat_memory_affinity
     u32    reserved3[2];
 } PACKED;
 
+struct srat_x2apic_affinity
+{
+    ACPI_SUB_HEADER_DEF
+    u16    reserved1;
+    u32    proximity;
+    u32    x2apic_id;
+    u32    flags;
+    u32    clock_domain;
+    u32    reserved2;
+} PACKED;
+
+/*
+ * MCFG (PCI express memory mapped configuration) table
+ */
+struct acpi_mcfg_allocation {
+    u64    address;
+    u16    pci_segment;
+    u8     start_bus_number;
+    u8     end_bus_number;
+    u32    reserved;
+} PACKED;
+
+struct acpi_table_mcfg {
+    ACPI_TABLE_HEADER_DEF
+    u8     reserved[8];
+    struct acpi_mcfg_allocation allocation[0];
+} PACKED;
+
 #include "acpi-dsdt.hex"
 
 static void
@@ -234,6 +276,40 @@ static const struct pci_device_id fadt_init_tbl[] = {
     PCI_DEVICE_END
 };
 
+// Set when the DSDT \_SB.PCI0._CRS was renamed so that the SSDT can
+// supply one that includes the 64bit pci window.
+static int PciCrs64;
+
+// Rename the PCI0 _CRS buffer in the DSDT to CRS0.  The pci host
+// bridge _CRS is the first named buffer starting with a bus number
+// descriptor.
+static int
+hide_dsdt_pci_crs(u8 *dsdt, int len)
+{
+    int i;
+    for (i=sizeof(struct acpi_table_header); i<len-16; i++) {
+        u8 *p = &dsdt[i];
+        if (p[0] != 0x08 || memcmp(&p[1], "_CRS", 4) || p[5] != 0x11)
+            continue;
+        // Skip the PkgLength and BufferSize of the buffer.
+        u8 *data = &p[6] + 1 + (p[6] >> 6);
+        if (*data == 0x0a)
+            data += 2;
+        else if (*data == 0x0b)
+            data += 3;
+        else
+            continue;
+        if (data[0] != 0x88 || data[3] != 0x02)
+            // Not a WordBusNumber descriptor.
+            continue;
+        memcpy(&p[1], "CRS0", 4);
+        struct acpi_table_header *h = (void*)dsdt;
+        h->checksum -= checksum(dsdt, len);
+        return 1;
+    }
+    return 0;
+}
+
 static void *
 build_fadt(struct pci_device *pci)
 {
@@ -253,6 +329,8 @@ build_fadt(struct pci_device *pci)
 
     /* DSDT */
     memcpy(dsdt, AmlCode, sizeof(AmlCode));
+    if (PCIMem64End)
+        PciCrs64 = hide_dsdt_pci_crs(dsdt, sizeof(AmlCode));
 
     /* FADT */
     memset(fadt, 0, sizeof(*fadt));
@@ -280,11 +358,21 @@ build_fadt(struct pci_device *pci)
     return fadt;
 }
 
+// Number of cpus that can be described with 8-bit apic ids.
+static inline int
+count_xapic_cpus(void)
+{
+    return MaxCountCPUs > MAX_XAPIC_ID + 1 ? MAX_XAPIC_ID + 1 : MaxCountCPUs;
+}
+
 static void*
 build_madt(void)
 {
+    int xapic_cpus = count_xapic_cpus();
     int madt_size = (sizeof(struct multiple_apic_table)
-                     + sizeof(struct madt_processor_apic) * MaxCountCPUs
+                     + sizeof(struct madt_processor_apic) * xapic_cpus
+                     + (sizeof(struct madt_local_x2apic)
+                        * (MaxCountCPUs - xapic_cpus))
                      + sizeof(struct madt_io_apic)
                      + sizeof(struct madt_intsrcovr) * 16);
     struct multiple_apic_table *madt = malloc_high(madt_size);
@@ -297,7 +385,7 @@ build_madt(void)
     madt->flags = cpu_to_le32(1);
     struct madt_processor_apic *apic = (void*)&madt[1];
     int i;
-    for (i=0; i<MaxCountCPUs; i++) {
+    for (i=0; i<xapic_cpus; i++) {
         apic->type = APIC_PROCESSOR;
         apic->length = sizeof(*apic);
         apic->processor_id = i;
@@ -308,7 +396,17 @@ build_madt(void)
             apic->flags = cpu_to_le32(0);
         apic++;
     }
-    struct madt_io_apic *io_apic = (void*)apic;
+    // Cpus with apic ids that don't fit in a byte use x2apic entries.
+    struct madt_local_x2apic *x2apic = (void*)apic;
+    for (; i<MaxCountCPUs; i++) {
+        x2apic->type = APIC_LOCAL_X2APIC;
+        x2apic->length = sizeof(*x2apic);
+        x2apic->x2apic_id = cpu_to_le32(i);
+        x2apic->uid = cpu_to_le32(i);
+        x2apic->flags = cpu_to_le32(i < CountCPUs);
+        x2apic++;
+    }
+    struct madt_io_apic *io_apic = (void*)x2apic;
     io_apic->type = APIC_IO;
     io_apic->length = sizeof(*io_apic);
     io_apic->io_apic_id = CountCPUs;
@@ -382,16 +480,90 @@ static unsigned char ssdt_proc[] = {
 #define SD_OFFSET_CPUID1 8
 #define SD_OFFSET_CPUID2 20
 
+// AML Device() object for cpus beyond the Processor() id range.
+// See src/ssdt-proc.dsl for info.
+static unsigned char ssdt_x2proc[] = {
+    0x5b,0x82,0x25,0x43,0x41,0x41,0x41,0x08,
+    0x5f,0x48,0x49,0x44,0x0d,0x41,0x43,0x50,
+    0x49,0x30,0x30,0x30,0x37,0x00,0x08,0x5f,
+    0x55,0x49,0x44,0x0c,0xaa,0xaa,0xaa,0xaa,
+    0x08,0x5f,0x53,0x54,0x41,0x0a,0x0f
+};
+#define SD_OFFSET_X2CPUHEX 4
+#define SD_OFFSET_X2CPUID 28
+#define SD_OFFSET_X2CPUSTA 38
+#define MAX_SSDT_CPUS 0x1000
+
+// Size of the Scope(PCI0) { Method(_CRS) ... } block in the SSDT.
+#define SSDT_CRS64_LEN (7 + 8 + 1 + 1 + 4 + (4 + 46 + 2) + 1)
+
+// Build the 64bit pci window _CRS (see build_ssdt).
+static u8 *
+build_pci_crs64(u8 *ssdt_ptr)
+{
+    *(ssdt_ptr++) = 0x10; // ScopeOp
+    ssdt_ptr = encodeLen(ssdt_ptr, SSDT_CRS64_LEN-1, 2);
+    *(ssdt_ptr++) = 'P';
+    *(ssdt_ptr++) = 'C';
+    *(ssdt_ptr++) = 'I';
+    *(ssdt_ptr++) = '0';
+    *(ssdt_ptr++) = 0x14; // MethodOp
+    ssdt_ptr = encodeLen(ssdt_ptr, SSDT_CRS64_LEN-7-1, 2);
+    *(ssdt_ptr++) = '_';
+    *(ssdt_ptr++) = 'C';
+    *(ssdt_ptr++) = 'R';
+    *(ssdt_ptr++) = 'S';
+    *(ssdt_ptr++) = 0x00;
+    *(ssdt_ptr++) = 0xa4; // ReturnOp
+    *(ssdt_ptr++) = 0x84; // ConcatResOp
+    *(ssdt_ptr++) = 'C';
+    *(ssdt_ptr++) = 'R';
+    *(ssdt_ptr++) = 'S';
+    *(ssdt_ptr++) = '0';
+    *(ssdt_ptr++) = 0x11; // BufferOp
+    ssdt_ptr = encodeLen(ssdt_ptr, 1+2+46+2, 1);
+    *(ssdt_ptr++) = 0x0a; // BytePrefix
+    *(ssdt_ptr++) = 46+2;
+
+    // QWordMemory(ResourceProducer, PosDecode, MinFixed, MaxFixed,
+    //             Cacheable, ReadWrite, ...)
+    *(ssdt_ptr++) = 0x8a;
+    *(ssdt_ptr++) = 46-3;
+    *(ssdt_ptr++) = 0x00;
+    *(ssdt_ptr++) = 0x00; // memory range
+    *(ssdt_ptr++) = 0x0c; // MinFixed, MaxFixed
+    *(ssdt_ptr++) = 0x03; // Cacheable, ReadWrite
+    u64 *qw = (void*)ssdt_ptr;
+    qw[0] = cpu_to_le64(0); // granularity
+    qw[1] = cpu_to_le64(PCIMem64Start);
+    qw[2] = cpu_to_le64(PCIMem64End);
+    qw[3] = cpu_to_le64(0); // translation offset
+    qw[4] = cpu_to_le64(PCIMem64End - PCIMem64Start + 1);
+    ssdt_ptr += 5 * sizeof(u64);
+    *(ssdt_ptr++) = 0x79; // EndTag
+    *(ssdt_ptr++) = 0x00;
+
+    *(ssdt_ptr++) = 0x00; // NullName
+    return ssdt_ptr;
+}
+
 #define SSDT_SIGNATURE 0x54445353 // SSDT
 static void*
 build_ssdt(void)
 {
-    int acpi_cpus = MaxCountCPUs > 0xff ? 0xff : MaxCountCPUs;
-    // length = ScopeOp + procs + NTYF method + CPON package
+    int acpi_cpus = count_xapic_cpus();
+    int x2_cpus = MaxCountCPUs - acpi_cpus;
+    if (acpi_cpus + x2_cpus > MAX_SSDT_CPUS)
+        x2_cpus = MAX_SSDT_CPUS - acpi_cpus;
+    // length = ScopeOp + procs + NTYF method + CPNT package + CPON package
+    //          + PCI0 _CRS
     int length = ((1+3+4)
                   + (acpi_cpus * sizeof(ssdt_proc))
-                  + (1+2+5+(12*acpi_cpus))
-                  + (6+2+1+(1*acpi_cpus)));
+                  + (x2_cpus * sizeof(ssdt_x2proc))
+                  + (1+1+4+1+10)
+                  + (5+1+2+1+(4*acpi_cpus))
+                  + (6+2+1+(1*acpi_cpus))
+                  + (PciCrs64 ? SSDT_CRS64_LEN : 0));
     u8 *ssdt = malloc_high(sizeof(struct acpi_table_header) + length);
     if (! ssdt) {
         warn_noalloc();
@@ -418,27 +590,50 @@ build_ssdt(void)
         ssdt_ptr += sizeof(ssdt_proc);
     }
 
-    // build "Method(NTFY, 2) {If (LEqual(Arg0, 0x00)) {Notify(CP00, Arg1)} ...}"
+    // build processor Device object for each x2apic processor
+    for (; i<acpi_cpus+x2_cpus; i++) {
+        memcpy(ssdt_ptr, ssdt_x2proc, sizeof(ssdt_x2proc));
+        ssdt_ptr[SD_OFFSET_X2CPUHEX] = getHex(i >> 8);
+        ssdt_ptr[SD_OFFSET_X2CPUHEX+1] = getHex(i >> 4);
+        ssdt_ptr[SD_OFFSET_X2CPUHEX+2] = getHex(i);
+        *(u32*)&ssdt_ptr[SD_OFFSET_X2CPUID] = cpu_to_le32(i);
+        ssdt_ptr[SD_OFFSET_X2CPUSTA] = (i < CountCPUs) ? 0x0F : 0x00;
+        ssdt_ptr += sizeof(ssdt_x2proc);
+    }
+
+    // build "Method(NTFY, 2) {Notify(DerefOf(Index(CPNT, Arg0)), Arg1)}"
     *(ssdt_ptr++) = 0x14; // MethodOp
-    ssdt_ptr = encodeLen(ssdt_ptr, 2+5+(12*acpi_cpus), 2);
+    ssdt_ptr = encodeLen(ssdt_ptr, 1+4+1+10, 1);
     *(ssdt_ptr++) = 'N';
     *(ssdt_ptr++) = 'T';
     *(ssdt_ptr++) = 'F';
     *(ssdt_ptr++) = 'Y';
     *(ssdt_ptr++) = 0x02;
+    *(ssdt_ptr++) = 0x86; // NotifyOp
+    *(ssdt_ptr++) = 0x83; // DerefOfOp
+    *(ssdt_ptr++) = 0x88; // IndexOp
+    *(ssdt_ptr++) = 'C';
+    *(ssdt_ptr++) = 'P';
+    *(ssdt_ptr++) = 'N';
+    *(ssdt_ptr++) = 'T';
+    *(ssdt_ptr++) = 0x68; // Arg0Op
+    *(ssdt_ptr++) = 0x00; // NullName
+    *(ssdt_ptr++) = 0x69; // Arg1Op
+
+    // build "Name(CPNT, Package() { CP00, CP01, ... })"
+    *(ssdt_ptr++) = 0x08; // NameOp
+    *(ssdt_ptr++) = 'C';
+    *(ssdt_ptr++) = 'P';
+    *(ssdt_ptr++) = 'N';
+    *(ssdt_ptr++) = 'T';
+    *(ssdt_ptr++) = 0x12; // PackageOp
+    ssdt_ptr = encodeLen(ssdt_ptr, 2+1+(4*acpi_cpus), 2);
+    *(ssdt_ptr++) = acpi_cpus;
     for (i=0; i<acpi_cpus; i++) {
-        *(ssdt_ptr++) = 0xA0; // IfOp
-        ssdt_ptr = encodeLen(ssdt_ptr, 11, 1);
-        *(ssdt_ptr++) = 0x93; // LEqualOp
-        *(ssdt_ptr++) = 0x68; // Arg0Op
-        *(ssdt_ptr++) = 0x0A; // BytePrefix
-        *(ssdt_ptr++) = i;
-        *(ssdt_ptr++) = 0x86; // NotifyOp
         *(ssdt_ptr++) = 'C';
         *(ssdt_ptr++) = 'P';
         *(ssdt_ptr++) = getHex(i >> 4);
         *(ssdt_ptr++) = getHex(i);
-        *(ssdt_ptr++) = 0x69; // Arg1Op
     }
 
     // build "Name(CPON, Package() { One, One, ..., Zero, Zero, ... })"
@@ -453,6 +648,11 @@ build_ssdt(void)
     for (i=0; i<acpi_cpus; i++)
         *(ssdt_ptr++) = (i < CountCPUs) ? 0x01 : 0x00;
 
+    // build "Scope(PCI0) { Method(_CRS) { Return(ConcatenateResTemplate(
+    //            CRS0, ResourceTemplate() { QWordMemory(...) })) } }"
+    if (PciCrs64)
+        ssdt_ptr = build_pci_crs64(ssdt_ptr);
+
     build_header((void*)ssdt, SSDT_SIGNATURE, ssdt_ptr - ssdt, 1);
 
     //hexdump(ssdt, ssdt_ptr - ssdt);
@@ -514,8 +714,10 @@ build_srat(void)
     qemu_cfg_get_numa_data(numadata, MaxCountCPUs + nb_numa_nodes);
 
     struct system_resource_affinity_table *srat;
+    int xapic_cpus = count_xapic_cpus();
     int srat_size = sizeof(*srat) +
-        sizeof(struct srat_processor_affinity) * MaxCountCPUs +
+        sizeof(struct srat_processor_affinity) * xapic_cpus +
+        sizeof(struct srat_x2apic_affinity) * (MaxCountCPUs - xapic_cpus) +
         sizeof(struct srat_memory_affinity) * (nb_numa_nodes + 2);
 
     srat = malloc_high(srat_size);
@@ -531,7 +733,7 @@ build_srat(void)
     int i;
     u64 curnode;
 
-    for (i = 0; i < MaxCountCPUs; ++i) {
+    for (i = 0; i < xapic_cpus; ++i) {
         core->type = SRAT_PROCESSOR;
         core->length = sizeof(*core);
         core->local_apic_id = i;
@@ -545,12 +747,21 @@ build_srat(void)
             core->flags = 0;
         core++;
     }
+    struct srat_x2apic_affinity *x2core = (void*)core;
+    for (; i < MaxCountCPUs; ++i) {
+        x2core->type = SRAT_X2APIC;
+        x2core->length = sizeof(*x2core);
+        x2core->x2apic_id = cpu_to_le32(i);
+        x2core->proximity = cpu_to_le32(*numadata++);
+        x2core->flags = cpu_to_le32(i < CountCPUs);
+        x2core++;
+    }
 
 
     /* the memory map is a bit tricky, it contains at least one hole
      * from 640k-1M and possibly another one from 3.5G-4G.
      */
-    struct srat_memory_affinity *numamem = (void*)core;
+    struct srat_memory_affinity *numamem = (void*)x2core;
     int slots = 0;
     u64 mem_len, mem_base, next_base = 0;
 
@@ -592,6 +803,29 @@ build_srat(void)
     return srat;
 }
 
+#define MCFG_SIGNATURE 0x4746434d // MCFG
+static void *
+build_mcfg(void)
+{
+    if (!PCIMmcfgBase)
+        return NULL;
+
+    int len = sizeof(struct acpi_table_mcfg)
+        + sizeof(struct acpi_mcfg_allocation);
+    struct acpi_table_mcfg *mcfg = malloc_high(len);
+    if (!mcfg) {
+        warn_noalloc();
+        return NULL;
+    }
+    memset(mcfg, 0, len);
+    mcfg->allocation[0].address = cpu_to_le64(PCIMmcfgBase);
+    mcfg->allocation[0].pci_segment = cpu_to_le16(0);
+    mcfg->allocation[0].start_bus_number = 0;
+    mcfg->allocation[0].end_bus_number = PCIMmcfgEndBus;
+    build_header((void*)mcfg, MCFG_SIGNATURE, len, 1);
+    return mcfg;
+}
+
 static const struct pci_device_id acpi_find_tbl[] = {
     /* PIIX4 Power Management device. */
     PCI_DEVICE(PCI_VENDOR_ID_INTEL, PCI_DEVICE_ID_INTEL_82371AB_3, NULL),
@@ -638,6 +872,7 @@ acpi_bios_init(void)
     ACPI_INIT_TABLE(build_madt());
     ACPI_INIT_TABLE(build_hpet());
     ACPI_INIT_TABLE(build_srat());
+    ACPI_INIT_TABLE(build_mcfg());
 
     u16 i, external_tables = qemu_cfg_acpi_additional_tables();
 
@@ -14,14 +14,179 @@
 #include "cmos.h" // inb_cmos
 #include "paravirt.h" // romfile_loadfile
 #include "pci.h" //pci_bdf_to_*
+#include "pci_ids.h" // PCI_CLASS_STORAGE_IDE
 
 
 /****************************************************************
  * Boot priority ordering
  ****************************************************************/
 
-static char **Bootorder;
+// A bootorder entry compiled into the pci device it refers to and the
+// parsed path components that follow that device.  For example,
+// "/pci@i0cf8/ide@1,1/drive@1/disk@0" becomes the 00:01.1 device with
+// nodes "drive@1" and "disk@0".
+#define BOOTORDER_MAXNODES 8
+
+struct bootorder_node {
+    const char *name;
+    u8 namelen, unitcount;
+    u32 unit, unit2;
+};
+
+struct bootorder_s {
+    struct bootorder_s *next;
+    int prio;
+    struct pci_device *pci;
+    struct bootorder_node leaf;
+    const char *romname;
+    int romnamelen;
+    int rom;
+    int nodecount;
+    struct bootorder_node nodes[BOOTORDER_MAXNODES];
+};
+
+#define BOOTORDER_HASHSIZE 16
+static struct bootorder_s *Bootorder;
 static int BootorderCount;
+// Entries chained by pci bdf (in priority order) and the named roms.
+static struct bootorder_s *BootorderHash[BOOTORDER_HASHSIZE];
+static struct bootorder_s *BootorderRoms;
+
+static u32
+parse_hex(const char **pp)
+{
+    const char *p = *pp;
+    u32 val = 0;
+    for (;; p++) {
+        char c = *p;
+        if (c >= '0' && c <= '9')
+            val = (val << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f')
+            val = (val << 4) | (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            val = (val << 4) | (c - 'A' + 10);
+        else
+            break;
+    }
+    *pp = p;
+    return val;
+}
+
+// Parse a ":romN" suffix.
+static const char *
+parse_rom(const char *p, int *rom)
+{
+    if (memcmp(p, ":rom", 4) != 0)
+        return p;
+    p += 4;
+    int val = 0;
+    while (*p >= '0' && *p <= '9')
+        val = val * 10 + *(p++) - '0';
+    *rom = val;
+    return p;
+}
+
+// Parse one "/name@unit,unit2" path component.
+static const char *
+parse_node(const char *p, struct bootorder_node *n)
+{
+    memset(n, 0, sizeof(*n));
+    if (*p == '/')
+        p++;
+    n->name = p;
+    while (*p && *p != '@' && *p != '/' && *p != ':')
+        p++;
+    n->namelen = p - n->name;
+    if (*p != '@')
+        return p;
+    p++;
+    n->unit = parse_hex(&p);
+    n->unitcount = 1;
+    if (*p == ',') {
+        p++;
+        n->unit2 = parse_hex(&p);
+        n->unitcount = 2;
+    }
+    return p;
+}
+
+static int
+node_named(struct bootorder_node *n, const char *name)
+{
+    int len = strlen(name);
+    return n->namelen == len && memcmp(n->name, name, len) == 0;
+}
+
+static int
+node_is(struct bootorder_node *n, const char *name, int unitcount, u32 unit)
+{
+    return (node_named(n, name)
+            && n->unitcount == unitcount && n->unit == unit);
+}
+
+// Find the pci device with the given parent (or root bus) and dev/fn.
+static struct pci_device *
+find_pci_node(struct pci_device *parent, int rootbus, int dev, int fn)
+{
+    struct pci_device *pci;
+    foreachpci(pci) {
+        if (pci->parent != parent || (!parent && pci->rootbus != rootbus))
+            continue;
+        if (pci_bdf_to_dev(pci->bdf) == dev && pci_bdf_to_fn(pci->bdf) == fn)
+            return pci;
+    }
+    return NULL;
+}
+
+#define FW_PCI_DOMAIN "/pci@i0cf8"
+
+// Compile a bootorder line into a struct bootorder_s.
+static void
+compile_bootorder(struct bootorder_s *b, const char *p)
+{
+    if (memcmp(p, "/rom@", 5) == 0) {
+        // Named rom - for example: /rom@genroms/linuxboot.bin:rom1
+        p += 5;
+        b->romname = p;
+        while (*p && *p != ':')
+            p++;
+        b->romnamelen = p - b->romname;
+        parse_rom(p, &b->rom);
+        return;
+    }
+
+    int rootbus = 0;
+    if (memcmp(p, "/pci-root@", 10) == 0) {
+        p += 10;
+        rootbus = parse_hex(&p);
+    }
+    int len = strlen(FW_PCI_DOMAIN);
+    if (memcmp(p, FW_PCI_DOMAIN, len) != 0 || (p[len] && p[len] != '/'))
+        return;
+    p += len;
+
+    // Walk the pci devices named in the path.
+    while (*p == '/') {
+        struct bootorder_node n;
+        const char *next = parse_node(p, &n);
+        if (!n.unitcount)
+            break;
+        struct pci_device *pci = find_pci_node(b->pci, rootbus
+                                               , n.unit, n.unit2);
+        if (!pci)
+            break;
+        b->pci = pci;
+        b->leaf = n;
+        p = next;
+    }
+    if (!b->pci)
+        return;
+    p = parse_rom(p, &b->rom);
+
+    // Parse the remaining nodes.
+    while (*p == '/' && b->nodecount < ARRAY_SIZE(b->nodes))
+        p = parse_node(p, &b->nodes[b->nodecount++]);
+}
 
 static void
 loadBootOrder(void)
@@ -40,92 +205,80 @@ loadBootOrder(void)
             BootorderCount++;
         i++;
     }
-    Bootorder = malloc_tmphigh(BootorderCount*sizeof(char*));
+    Bootorder = malloc_tmphigh(BootorderCount*sizeof(Bootorder[0]));
     if (!Bootorder) {
         warn_noalloc();
         free(f);
         BootorderCount = 0;
         return;
     }
+    memset(Bootorder, 0, BootorderCount*sizeof(Bootorder[0]));
 
     dprintf(3, "boot order:\n");
-    i = 0;
-    do {
-        Bootorder[i] = f;
-        f = strchr(f, '\n');
-        if (f)
-            *(f++) = '\0';
-        nullTrailingSpace(Bootorder[i]);
-        dprintf(3, "%d: %s\n", i+1, Bootorder[i]);
-        i++;
-    } while (f);
-}
+    char *line = f;
+    for (i=0; i<BootorderCount; i++) {
+        char *next = strchr(line, '\n');
+        if (next)
+            *(next++) = '\0';
+        nullTrailingSpace(line);
+        struct bootorder_s *b = &Bootorder[i];
+        b->prio = i+1;
+        compile_bootorder(b, line);
+        if (b->pci)
+            dprintf(3, "%d: %s (pci %02x:%02x.%x)\n", i+1, line
+                    , pci_bdf_to_bus(b->pci->bdf), pci_bdf_to_dev(b->pci->bdf)
+                    , pci_bdf_to_fn(b->pci->bdf));
+        else
+            dprintf(3, "%d: %s\n", i+1, line);
+        line = next;
+    }
 
-// See if 'str' starts with 'glob' - if glob contains an '*' character
-// it will match any number of characters in str that aren't a '/' or
-// the next glob character.
-static char *
-glob_prefix(const char *glob, const char *str)
-{
-    for (;;) {
-        if (!*glob && (!*str || *str == '/'))
-            return (char*)str;
-        if (*glob == '*') {
-            if (!*str || *str == '/' || *str == glob[1])
-                glob++;
-            else
-                str++;
+    // Build the lookup chains (back to front to keep priority order).
+    for (i=BootorderCount-1; i>=0; i--) {
+        struct bootorder_s *b = &Bootorder[i];
+        struct bootorder_s **head;
+        if (b->romname)
+            head = &BootorderRoms;
+        else if (b->pci)
+            head = &BootorderHash[b->pci->bdf % BOOTORDER_HASHSIZE];
+        else
             continue;
-        }
-        if (*glob != *str)
-            return NULL;
-        glob++;
-        str++;
+        b->next = *head;
+        *head = b;
     }
 }
 
-// Search the bootorder list for the given glob pattern.
-static int
-find_prio(const char *glob)
+// Return the first bootorder entry for a given pci device (and leaf
+// name - NULL matches any) after 'b'.
+static struct bootorder_s *
+next_pci_entry(struct bootorder_s *b, struct pci_device *pci, const char *leaf)
 {
-    dprintf(1, "Searching bootorder for: %s\n", glob);
-    int i;
-    for (i = 0; i < BootorderCount; i++)
-        if (glob_prefix(glob, Bootorder[i]))
-            return i+1;
-    return -1;
-}
-
-#define FW_PCI_DOMAIN "/pci@i0cf8"
-
-static char *
-build_pci_path(char *buf, int max, const char *devname, struct pci_device *pci)
-{
-    // Build the string path of a bdf - for example: /pci@i0cf8/isa@1,2
-    char *p = buf;
-    if (pci->parent) {
-        p = build_pci_path(p, max, "pci-bridge", pci->parent);
-    } else {
-        if (pci->rootbus)
-            p += snprintf(p, max, "/pci-root@%x", pci->rootbus);
-        p += snprintf(p, buf+max-p, "%s", FW_PCI_DOMAIN);
+    b = b ? b->next : BootorderHash[pci->bdf % BOOTORDER_HASHSIZE];
+    for (; b; b = b->next) {
+        if (b->pci != pci)
+            continue;
+        if (leaf && !node_named(&b->leaf, leaf))
+            continue;
+        return b;
     }
-
-    int dev = pci_bdf_to_dev(pci->bdf), fn = pci_bdf_to_fn(pci->bdf);
-    p += snprintf(p, buf+max-p, "/%s@%x", devname, dev);
-    if (fn)
-        p += snprintf(p, buf+max-p, ",%x", fn);
-    return p;
+    return NULL;
 }
 
+#define foreach_pci_entry(B, PCI, LEAF)                         \
+    for (B = next_pci_entry(NULL, PCI, LEAF); B                 \
+         ; B = next_pci_entry(B, PCI, LEAF))
+
 int bootprio_find_pci_device(struct pci_device *pci)
 {
     if (!CONFIG_BOOTORDER)
         return -1;
     // Find pci device - for example: /pci@i0cf8/ethernet@5
-    char desc[256];
-    build_pci_path(desc, sizeof(desc), "*", pci);
-    return find_prio(desc);
+    struct bootorder_s *b;
+    foreach_pci_entry(b, pci, NULL) {
+        if (!b->rom)
+            return b->prio;
+    }
+    return -1;
 }
 
 int bootprio_find_ata_device(struct pci_device *pci, int chanid, int slave)
@@ -136,10 +289,14 @@ int bootprio_find_ata_device(struct pci_device *pci, int chanid, int slave)
         // support only pci machine for now
         return -1;
     // Find ata drive - for example: /pci@i0cf8/ide@1,1/drive@1/disk@0
-    char desc[256], *p;
-    p = build_pci_path(desc, sizeof(desc), "*", pci);
-    snprintf(p, desc+sizeof(desc)-p, "/drive@%x/disk@%x", chanid, slave);
-    return find_prio(desc);
+    struct bootorder_s *b;
+    foreach_pci_entry(b, pci, NULL) {
+        if (!b->rom && b->nodecount >= 2
+            && node_is(&b->nodes[0], "drive", 1, chanid)
+            && node_is(&b->nodes[1], "disk", 1, slave))
+            return b->prio;
+    }
+    return -1;
 }
 
 int bootprio_find_fdc_device(struct pci_device *pci, int port, int fdid)
@@ -150,10 +307,14 @@ int bootprio_find_fdc_device(struct pci_device *pci, int port, int fdid)
         // support only pci machine for now
         return -1;
     // Find floppy - for example: /pci@i0cf8/isa@1/fdc@03f1/floppy@0
-    char desc[256], *p;
-    p = build_pci_path(desc, sizeof(desc), "isa", pci);
-    snprintf(p, desc+sizeof(desc)-p, "/fdc@%04x/floppy@%x", port, fdid);
-    return find_prio(desc);
+    struct bootorder_s *b;
+    foreach_pci_entry(b, pci, "isa") {
+        if (!b->rom && b->nodecount >= 2
+            && node_is(&b->nodes[0], "fdc", 1, port)
+            && node_is(&b->nodes[1], "floppy", 1, fdid))
+            return b->prio;
+    }
+    return -1;
 }
 
 int bootprio_find_pci_rom(struct pci_device *pci, int instance)
@@ -161,11 +322,12 @@ int bootprio_find_pci_rom(struct pci_device *pci, int instance)
     if (!CONFIG_BOOTORDER)
         return -1;
     // Find pci rom - for example: /pci@i0cf8/scsi@3:rom2
-    char desc[256], *p;
-    p = build_pci_path(desc, sizeof(desc), "*", pci);
-    if (instance)
-        snprintf(p, desc+sizeof(desc)-p, ":rom%d", instance);
-    return find_prio(desc);
+    struct bootorder_s *b;
+    foreach_pci_entry(b, pci, NULL) {
+        if (b->rom == instance)
+            return b->prio;
+    }
+    return -1;
 }
 
 int bootprio_find_named_rom(const char *name, int instance)
@@ -173,11 +335,14 @@ int bootprio_find_named_rom(const char *name, int instance)
     if (!CONFIG_BOOTORDER)
         return -1;
     // Find named rom - for example: /rom@genroms/linuxboot.bin
-    char desc[256], *p;
-    p = desc + snprintf(desc, sizeof(desc), "/rom@%s", name);
-    if (instance)
-        snprintf(p, desc+sizeof(desc)-p, ":rom%d", instance);
-    return find_prio(desc);
+    int len = strlen(name);
+    struct bootorder_s *b;
+    for (b = BootorderRoms; b; b = b->next) {
+        if (b->romnamelen == len && memcmp(b->romname, name, len) == 0
+            && b->rom == instance)
+            return b->prio;
+    }
+    return -1;
 }
 
 int bootprio_find_usb(struct pci_device *pci, u64 path)
@@ -185,16 +350,26 @@ int bootprio_find_usb(struct pci_device *pci, u64 path)
     if (!CONFIG_BOOTORDER)
         return -1;
     // Find usb - for example: /pci@i0cf8/usb@1,2/hub@1/network@0/ethernet@0
-    int i;
-    char desc[256], *p;
-    p = build_pci_path(desc, sizeof(desc), "usb", pci);
-    for (i=56; i>0; i-=8) {
-        int port = (path >> i) & 0xff;
-        if (port != 0xff)
-            p += snprintf(p, desc+sizeof(desc)-p, "/hub@%x", port);
+    struct bootorder_s *b;
+    foreach_pci_entry(b, pci, "usb") {
+        if (b->rom)
+            continue;
+        int i, n = 0;
+        for (i=56; i>0; i-=8) {
+            int port = (path >> i) & 0xff;
+            if (port == 0xff)
+                continue;
+            if (n >= b->nodecount || !node_is(&b->nodes[n], "hub", 1, port))
+                break;
+            n++;
+        }
+        if (i > 0 || n >= b->nodecount)
+            continue;
+        struct bootorder_node *dev = &b->nodes[n];
+        if (dev->unitcount == 1 && dev->unit == (u32)(path & 0xff))
+            return b->prio;
     }
-    snprintf(p, desc+sizeof(desc)-p, "/*@%x", (u32)(path & 0xff));
-    return find_prio(desc);
+    return -1;
 }
 
 
@@ -244,6 +419,76 @@ boot_setup(void)
 }
 
 
+/****************************************************************
+ * Fast boot
+ ****************************************************************/
+
+// Value stored in the bda soft reset flag to request a full device
+// initialization after a failed fast boot.
+#define FASTBOOT_FULLINIT 0x4642
+
+static int FastBootFullInit;
+// Controller types skipped by fast boot.
+static int FastBootSkipped;
+// Set once a device matching the first bootorder entry is registered.
+static int FastBootFound;
+
+// Check for a restart requested by a failed fast boot.  This must be
+// called before the bda is cleared.
+void
+boot_check_fullinit(void)
+{
+    if (CONFIG_FASTBOOT && GET_BDA(soft_reset_flag) == FASTBOOT_FULLINIT)
+        FastBootFullInit = 1;
+}
+
+// Return the controller types to initialize during post.  In fast
+// boot mode this is just what the first bootorder entry needs.
+int
+boot_init_mask(void)
+{
+    if (!CONFIG_FASTBOOT || FastBootFullInit || !BootorderCount)
+        return BOOT_INIT_ALL;
+
+    struct bootorder_s *b = &Bootorder[0];
+    struct pci_device *pci = b->pci;
+    if (!b->romname && !pci)
+        return BOOT_INIT_ALL;
+    int mask;
+    if (b->romname || b->rom)
+        mask = BOOT_INIT_ROMS;
+    else if (b->nodecount && node_named(&b->nodes[0], "fdc"))
+        mask = BOOT_INIT_FLOPPY;
+    else if (node_named(&b->leaf, "usb"))
+        mask = BOOT_INIT_USB;
+    else if (pci->vendor == PCI_VENDOR_ID_REDHAT_QUMRANET
+             && pci->device == PCI_DEVICE_ID_VIRTIO_BLK)
+        mask = BOOT_INIT_VIRTIO;
+    else if (pci->class == PCI_CLASS_STORAGE_IDE)
+        mask = BOOT_INIT_ATA;
+    else if (pci->class == PCI_CLASS_STORAGE_SATA)
+        mask = BOOT_INIT_AHCI;
+    else
+        mask = BOOT_INIT_ROMS;
+    mask |= BOOT_INIT_BASE;
+    FastBootSkipped = BOOT_INIT_ALL & ~mask;
+    dprintf(1, "Fast boot: init mask %x\n", mask);
+    return mask;
+}
+
+// Return the controller types still to be initialized after a fast
+// boot initialization pass (zero if the preferred device was found).
+int
+boot_init_remaining(int initmask)
+{
+    if (!FastBootSkipped || FastBootFound)
+        return 0;
+    dprintf(1, "Fast boot: preferred device not found - init all devices\n");
+    FastBootSkipped = 0;
+    return BOOT_INIT_ALL & ~initmask;
+}
+
+
 /****************************************************************
  * BootList handling
  ****************************************************************/
@@ -282,6 +527,8 @@ bootentry_add(int type, int prio, u32 data, const char *desc)
     be->priority = prio;
     be->data = data;
     be->description = desc ?: "?";
+    if (prio == 1)
+        FastBootFound = 1;
     dprintf(3, "Registering bootable: %s (type:%d prio:%d data:%x)\n"
             , be->description, type, prio, data);
 
@@ -604,6 +851,15 @@ do_boot(u16 seq_nr)
         panic("Boot support not compiled in.\n");
 
     if (seq_nr >= BEVCount) {
+        if (CONFIG_FASTBOOT && FastBootSkipped) {
+            // Restart with all controllers initialized.
+            printf("Fast boot failed - restarting with all devices.\n");
+            SET_BDA(soft_reset_flag, FASTBOOT_FULLINIT);
+            struct bregs br;
+            memset(&br, 0, sizeof(br));
+            br.code = FUNC16(reset_vector);
+            call16(&br);
+        }
         printf("No bootable device.\n");
         // Loop with irqs enabled - this allows ctrl+alt+delete to work.
         for (;;)
@@ -20,4 +20,17 @@ int bootprio_find_pci_rom(struct pci_device *pci, int instance);
 int bootprio_find_named_rom(const char *name, int instance);
 int bootprio_find_usb(struct pci_device *pci, u64 path);
 
+// Controller types for fast boot (see boot_init_mask).
+#define BOOT_INIT_BASE    (1<<0)
+#define BOOT_INIT_FLOPPY  (1<<1)
+#define BOOT_INIT_ATA     (1<<2)
+#define BOOT_INIT_AHCI    (1<<3)
+#define BOOT_INIT_USB     (1<<4)
+#define BOOT_INIT_VIRTIO  (1<<5)
+#define BOOT_INIT_ROMS    (1<<6)
+#define BOOT_INIT_ALL     0x7f
+void boot_check_fullinit(void);
+int boot_init_mask(void);
+int boot_init_remaining(int initmask);
+
 #endif // __BOOT_H
@@ -148,16 +148,130 @@ find_videomode(struct vesa_info *vesa_info, struct vesa_mode_info *mode_info
 
 static int BootsplashActive;
 
+/****************************************************************
+ * Pre-converted (framebuffer native) splash images
+ ****************************************************************/
+
+// A "bootsplash.raw" file is a header followed by an lzma stream
+// (as produced by "lzma -c") of pixel data that is already in the
+// exact layout of the target video mode.  See tools/buildsplash.py.
+struct raw_splash_header {
+    u32 magic;
+    u16 width;
+    u16 height;
+    u32 bytes_per_line;
+    u8 bits_per_pixel;
+    u8 red_mask_size;
+    u8 red_mask_pos;
+    u8 green_mask_size;
+    u8 green_mask_pos;
+    u8 blue_mask_size;
+    u8 blue_mask_pos;
+    u8 reserved;
+} PACKED;
+
+#define RAW_SPLASH_MAGIC 0x5a4c5053 // SPLZ
+
+static struct raw_splash_header *
+raw_splash_decode(u8 *filedata, int filesize)
+{
+    struct raw_splash_header *hdr = (void*)filedata;
+    if (filesize < sizeof(*hdr) || hdr->magic != RAW_SPLASH_MAGIC
+        || !hdr->width || !hdr->height
+        || hdr->bytes_per_line < hdr->width * DIV_ROUND_UP(
+               hdr->bits_per_pixel, 8))
+        return NULL;
+    return hdr;
+}
+
+// Check that the pixel encoding of the image matches the video mode.
+static int
+raw_splash_check_mode(struct raw_splash_header *hdr
+                      , struct vesa_mode_info *mode_info)
+{
+    if (mode_info->bits_per_pixel != hdr->bits_per_pixel)
+        return -1;
+    if (hdr->bits_per_pixel <= 8)
+        return 0;
+    if (mode_info->red_mask_size != hdr->red_mask_size
+        || mode_info->red_mask_pos != hdr->red_mask_pos
+        || mode_info->green_mask_size != hdr->green_mask_size
+        || mode_info->green_mask_pos != hdr->green_mask_pos
+        || mode_info->blue_mask_size != hdr->blue_mask_size
+        || mode_info->blue_mask_pos != hdr->blue_mask_pos)
+        return -1;
+    return 0;
+}
+
+// Uncompress a pre-converted image into the framebuffer.
+static int
+raw_splash_show(struct raw_splash_header *hdr, int filesize
+                , void *framebuffer, struct vesa_mode_info *mode_info)
+{
+    u8 *src = (void*)&hdr[1];
+    u32 linelen = hdr->bytes_per_line;
+    u32 imagesize = linelen * hdr->height;
+    // The lzma stream starts with 5 bytes of properties and an 8 byte size.
+    if (filesize < sizeof(*hdr) + 13) {
+        dprintf(1, "Bootsplash image truncated (%d bytes)\n", filesize);
+        return -1;
+    }
+    u32 srclen = filesize - sizeof(*hdr);
+    if (linelen == mode_info->bytes_per_scanline) {
+        // Single pass - no intermediate buffer and no pixel conversion.
+        int ret = ulzma(framebuffer, imagesize, src, srclen);
+        if (ret < 0)
+            return ret;
+        if (ret != imagesize) {
+            dprintf(1, "Bootsplash image short (%d of %d bytes)\n"
+                    , ret, imagesize);
+            return -1;
+        }
+        return 0;
+    }
+
+    // Scanline pitch of card differs from image - uncompress to a
+    // buffer and copy line by line.
+    u8 *picture = malloc_tmphigh(imagesize);
+    if (!picture) {
+        warn_noalloc();
+        return -1;
+    }
+    int ret = ulzma(picture, imagesize, src, srclen);
+    if (ret >= 0 && ret != imagesize) {
+        dprintf(1, "Bootsplash image short (%d of %d bytes)\n"
+                , ret, imagesize);
+        ret = -1;
+    }
+    if (ret >= 0) {
+        u32 copylen = mode_info->bytes_per_scanline;
+        if (copylen > linelen)
+            copylen = linelen;
+        int i;
+        for (i=0; i<hdr->height; i++)
+            iomemcpy(framebuffer + i * mode_info->bytes_per_scanline
+                     , picture + i * linelen, copylen);
+        ret = 0;
+    }
+    free(picture);
+    return ret;
+}
+
 void
 enable_bootsplash(void)
 {
     if (!CONFIG_BOOTSPLASH)
         return;
-    /* splash picture can be bmp or jpeg file */
+    /* splash picture can be raw, bmp or jpeg file */
     dprintf(3, "Checking for bootsplash\n");
-    u8 type = 0; /* 0 means jpg, 1 means bmp, default is 0=jpg */
+    /* 0 means jpg, 1 means bmp, 2 means raw, default is 0=jpg */
+    u8 type = 2;
     int filesize;
-    u8 *filedata = romfile_loadfile("bootsplash.jpg", &filesize);
+    u8 *filedata = romfile_loadfile("bootsplash.raw", &filesize);
+    if (!filedata) {
+        type = 0;
+        filedata = romfile_loadfile("bootsplash.jpg", &filesize);
+    }
     if (!filedata) {
         filedata = romfile_loadfile("bootsplash.bmp", &filesize);
         if (!filedata)
@@ -169,6 +283,7 @@ enable_bootsplash(void)
     u8 *picture = NULL; /* data buff used to be flushed to the video buf */
     struct jpeg_decdata *jpeg = NULL;
     struct bmp_decdata *bmp = NULL;
+    struct raw_splash_header *raw = NULL;
     struct vesa_info *vesa_info = malloc_tmplow(sizeof(*vesa_info));
     struct vesa_mode_info *mode_info = malloc_tmplow(sizeof(*mode_info));
     if (!vesa_info || !mode_info) {
@@ -199,7 +314,18 @@ enable_bootsplash(void)
 
     int ret, width, height;
     int bpp_require = 0;
-    if (type == 0) {
+    if (type == 2) {
+        /* Parse raw header and get image size and pixel format. */
+        dprintf(5, "Decoding bootsplash.raw\n");
+        raw = raw_splash_decode(filedata, filesize);
+        if (!raw) {
+            dprintf(1, "bootsplash.raw has an invalid header\n");
+            goto done;
+        }
+        width = raw->width;
+        height = raw->height;
+        bpp_require = raw->bits_per_pixel;
+    } else if (type == 0) {
         jpeg = jpeg_alloc();
         if (!jpeg) {
             warn_noalloc();
@@ -229,7 +355,8 @@ enable_bootsplash(void)
         bmp_get_size(bmp, &width, &height);
         bpp_require = 24;
     }
-    /* jpeg would use 16 or 24 bpp video mode, BMP use 24bpp mode only */
+    /* jpeg would use 16 or 24 bpp video mode, BMP use 24bpp mode only,
+     * raw images use exactly the mode they were converted for */
 
     // Try to find a graphics mode with the corresponding dimensions.
     int videomode = find_videomode(vesa_info, mode_info, width, height,
@@ -246,12 +373,19 @@ enable_bootsplash(void)
     dprintf(3, "bytes per scanline: %d\n", mode_info->bytes_per_scanline);
     dprintf(3, "bits per pixel: %d\n", depth);
 
-    // Allocate space for image and decompress it.
     int imagesize = height * mode_info->bytes_per_scanline;
-    picture = malloc_tmphigh(imagesize);
-    if (!picture) {
-        warn_noalloc();
-        goto done;
+    if (type == 2) {
+        if (raw_splash_check_mode(raw, mode_info)) {
+            dprintf(1, "bootsplash.raw pixel layout does not match mode\n");
+            goto done;
+        }
+    } else {
+        // Allocate space for image and decompress it.
+        picture = malloc_tmphigh(imagesize);
+        if (!picture) {
+            warn_noalloc();
+            goto done;
+        }
     }
 
     if (type == 0) {
@@ -262,7 +396,7 @@ enable_bootsplash(void)
             dprintf(1, "jpeg_show failed with return code %d...\n", ret);
             goto done;
         }
-    } else {
+    } else if (type == 1) {
         dprintf(5, "Decompressing bootsplash.bmp\n");
         ret = bmp_show(bmp, picture, width, height, depth,
                            mode_info->bytes_per_scanline);
@@ -282,12 +416,21 @@ enable_bootsplash(void)
         dprintf(1, "set_mode failed.\n");
         goto done;
     }
+    BootsplashActive = 1;
 
     /* Show the picture */
     dprintf(5, "Showing bootsplash picture\n");
-    iomemcpy(framebuffer, picture, imagesize);
+    if (type == 2) {
+        ret = raw_splash_show(raw, filesize, framebuffer, mode_info);
+        if (ret) {
+            dprintf(1, "raw_splash_show failed with return code %d...\n"
+                    , ret);
+            goto done;
+        }
+    } else {
+        iomemcpy(framebuffer, picture, imagesize);
+    }
     dprintf(5, "Bootsplash copy complete\n");
-    BootsplashActive = 1;
 
 done:
     free(filedata);
@@ -20,6 +20,8 @@
 #define CONFIG_MAX_BIOSTABLE 2048
 // Space to reserve in high-memory for tables
 #define CONFIG_MAX_HIGHTABLE (64*1024)
+// Space to reserve in high-memory for the option rom cache
+#define CONFIG_MAX_ROMCACHE (BUILD_BIOS_ADDR - BUILD_ROM_START + 4096)
 // Largest supported externaly facing drive id
 #define CONFIG_MAX_EXTDRIVE 16
 
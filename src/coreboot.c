@@ -142,7 +142,8 @@ coreboot_fill_map(void)
         goto fail;
 
     u64 maxram = 0, maxram_over4G = 0;
-    int i, count = MEM_RANGE_COUNT(cbm);
+    struct e820entry batch[16];
+    int i, n = 0, count = MEM_RANGE_COUNT(cbm);
     for (i=0; i<count; i++) {
         struct cb_memory_range *m = &cbm->map[i];
         u32 type = m->type;
@@ -157,7 +158,13 @@ coreboot_fill_map(void)
             } else if (end > maxram)
                 maxram = end;
         }
-        add_e820(m->start, m->size, type);
+        batch[n].start = m->start;
+        batch[n].size = m->size;
+        batch[n].type = type;
+        if (++n == ARRAY_SIZE(batch) || i == count-1) {
+            add_e820_list(batch, n);
+            n = 0;
+        }
     }
 
     RamSize = maxram;
@@ -231,38 +238,53 @@ coreboot_copy_biostable(void)
  * ulzma
  ****************************************************************/
 
-// Uncompress data in flash to an area of memory.
+// Uncompress the first 'dstlen' bytes of lzma data.
 static int
-ulzma(u8 *dst, u32 maxlen, const u8 *src, u32 srclen)
+__ulzma(u8 *dst, u32 dstlen, const u8 *src, u32 srclen)
 {
-    dprintf(3, "Uncompressing data %d@%p to %d@%p\n", srclen, src, maxlen, dst);
     CLzmaDecoderState state;
     int ret = LzmaDecodeProperties(&state.Properties, src, LZMA_PROPERTIES_SIZE);
     if (ret != LZMA_RESULT_OK) {
         dprintf(1, "LzmaDecodeProperties error - %d\n", ret);
         return -1;
     }
+    // The probability table fits on the stack for the default lc+lp
+    // of 3 - larger settings need a temporary allocation.
     u8 scratch[15980];
+    void *probs = scratch;
     int need = (LzmaGetNumProbs(&state.Properties) * sizeof(CProb));
     if (need > sizeof(scratch)) {
-        dprintf(1, "LzmaDecode need %d have %d\n", need, (unsigned int)sizeof(scratch));
-        return -1;
+        probs = malloc_tmphigh(need);
+        if (!probs) {
+            dprintf(1, "LzmaDecode need %d have %d\n", need, (unsigned int)sizeof(scratch));
+            return -1;
+        }
     }
-    state.Probs = (CProb *)scratch;
+    state.Probs = probs;
 
-    u32 dstlen = *(u32*)(src + LZMA_PROPERTIES_SIZE);
-    if (dstlen > maxlen) {
-        dprintf(1, "LzmaDecode too large (max %d need %d)\n", maxlen, dstlen);
-        return -1;
-    }
     u32 inProcessed, outProcessed;
     ret = LzmaDecode(&state, src + LZMA_PROPERTIES_SIZE + 8, srclen
                      , &inProcessed, dst, dstlen, &outProcessed);
+    if (probs != scratch)
+        free(probs);
     if (ret) {
         dprintf(1, "LzmaDecode returned %d\n", ret);
         return -1;
     }
-    return dstlen;
+    return outProcessed;
+}
+
+// Uncompress data in flash to an area of memory.
+int
+ulzma(u8 *dst, u32 maxlen, const u8 *src, u32 srclen)
+{
+    dprintf(3, "Uncompressing data %d@%p to %d@%p\n", srclen, src, maxlen, dst);
+    u32 dstlen = *(u32*)(src + LZMA_PROPERTIES_SIZE);
+    if (dstlen > maxlen) {
+        dprintf(1, "LzmaDecode too large (max %d need %d)\n", maxlen, dstlen);
+        return -1;
+    }
+    return __ulzma(dst, dstlen, src, srclen);
 }
 
 
@@ -305,6 +327,10 @@ cbfs_setup(void)
 
 #define CBFS_FILE_MAGIC 0x455649484352414cLL // LARCHIVE
 
+#define CBFS_COMPRESS_NONE  0
+#define CBFS_COMPRESS_LZMA  1
+#define CBFS_COMPRESS_LZ4   2
+
 struct cbfs_file {
     u64 magic;
     u32 len;
@@ -345,11 +371,176 @@ cbfs_getnext(struct cbfs_file *file)
     return cbfs_verify(file);
 }
 
+// Return the length of a filename without its compression extension.
+static int
+cbfs_baselen(const char *name, int len, int *comp)
+{
+    if (len > 5 && strcmp(&name[len-5], ".lzma") == 0) {
+        *comp = CBFS_COMPRESS_LZMA;
+        return len - 5;
+    }
+    if (len > 4 && strcmp(&name[len-4], ".lz4") == 0) {
+        *comp = CBFS_COMPRESS_LZ4;
+        return len - 4;
+    }
+    *comp = CBFS_COMPRESS_NONE;
+    return len;
+}
+
+
+/****************************************************************
+ * CBFS file index
+ ****************************************************************/
+
+// The file headers are in (slow) flash, so the archive is walked once
+// and the file names are copied into a ram index.  The index is kept
+// in archive order, and each file is also chained into a hash bucket
+// by its name without any compression extension.  The index is in
+// temporary memory and is only used during POST.
+
+struct cbfs_index_s {
+    struct cbfs_file *file;
+    const char *name;
+    u16 baselen, next;
+    u8 comp;
+};
+
+#define CBFS_HASH_SIZE 64
+#define CBFS_INDEX_END 0xffff
+
+static struct cbfs_index_s *CBFSIndex;
+static int CBFSIndexCount, CBFSIndexFailed;
+static u16 CBFSHash[CBFS_HASH_SIZE];
+
+static u32
+cbfs_hash(const char *name, int len)
+{
+    u32 hash = 5381;
+    while (len--)
+        hash = (hash * 33) ^ (u8)*name++;
+    return hash % CBFS_HASH_SIZE;
+}
+
+// Walk the CBFS archive and build the ram index.
+static void
+cbfs_index_setup(void)
+{
+    if (CBFSIndex || CBFSIndexFailed || !CBHDR)
+        return;
+
+    // Count the files and the space needed for their names.
+    int count = 0;
+    u32 namesize = 0;
+    struct cbfs_file *file;
+    for (file = cbfs_getfirst(); file; file = cbfs_getnext(file)) {
+        count++;
+        namesize += strlen(file->filename) + 1;
+    }
+    if (!count || count >= CBFS_INDEX_END)
+        return;
+    struct cbfs_index_s *index = malloc_tmphigh(
+        count * sizeof(index[0]) + namesize);
+    if (!index) {
+        warn_noalloc();
+        CBFSIndexFailed = 1;
+        return;
+    }
+
+    // Copy the file names and note their compression.
+    char *names = (void*)&index[count];
+    int i;
+    for (file = cbfs_getfirst(), i=0; file && i<count
+             ; file = cbfs_getnext(file), i++) {
+        struct cbfs_index_s *e = &index[i];
+        const char *src = file->filename;
+        char *dst = names;
+        while ((*dst++ = *src++) && dst < (char*)&index[count] + namesize)
+            ;
+        *(dst-1) = '\0';
+        int comp;
+        e->file = file;
+        e->name = names;
+        e->baselen = cbfs_baselen(names, dst - names - 1, &comp);
+        e->comp = comp;
+        names = dst;
+    }
+    count = i;
+
+    // Build the hash chains (back to front to keep archive order).
+    for (i=0; i<CBFS_HASH_SIZE; i++)
+        CBFSHash[i] = CBFS_INDEX_END;
+    for (i=count-1; i>=0; i--) {
+        struct cbfs_index_s *e = &index[i];
+        u32 hash = cbfs_hash(e->name, e->baselen);
+        e->next = CBFSHash[hash];
+        CBFSHash[hash] = i;
+    }
+    CBFSIndex = index;
+    CBFSIndexCount = count;
+    dprintf(3, "Indexed %d CBFS files\n", count);
+}
+
+// Find the index entry of a file.
+static struct cbfs_index_s *
+cbfs_index_find(struct cbfs_file *file)
+{
+    // Entries are in archive order, which is also address order.
+    int lo = 0, hi = CBFSIndexCount - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        struct cbfs_index_s *e = &CBFSIndex[mid];
+        if (e->file == file)
+            return e;
+        if (e->file < file)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return NULL;
+}
+
+// Lookup a name in the index.  With 'data' set, files with the name
+// plus a compression extension also match.  Returns the first match in
+// archive order.
+static struct cbfs_file *
+cbfs_index_lookup(const char *fname, int data)
+{
+    int comp, len = strlen(fname);
+    int baselen = cbfs_baselen(fname, len, &comp);
+    int best = CBFS_INDEX_END, i;
+    for (i = CBFSHash[cbfs_hash(fname, baselen)]; i != CBFS_INDEX_END
+             ; i = CBFSIndex[i].next)
+        if (strcmp(fname, CBFSIndex[i].name) == 0) {
+            best = i;
+            break;
+        }
+    if (data)
+        for (i = CBFSHash[cbfs_hash(fname, len)]; i != CBFS_INDEX_END && i < best
+                 ; i = CBFSIndex[i].next) {
+            struct cbfs_index_s *e = &CBFSIndex[i];
+            if (e->baselen == len && memcmp(fname, e->name, len) == 0) {
+                best = i;
+                break;
+            }
+        }
+    if (best == CBFS_INDEX_END)
+        return NULL;
+    return CBFSIndex[best].file;
+}
+
+
+/****************************************************************
+ * CBFS file lookup
+ ****************************************************************/
+
 // Find the file with the given filename.
 struct cbfs_file *
 cbfs_findfile(const char *fname)
 {
     dprintf(3, "Searching CBFS for %s\n", fname);
+    cbfs_index_setup();
+    if (CBFSIndex)
+        return cbfs_index_lookup(fname, 0);
     struct cbfs_file *file;
     for (file = cbfs_getfirst(); file; file = cbfs_getnext(file))
         if (strcmp(fname, file->filename) == 0)
@@ -366,6 +557,20 @@ cbfs_findprefix(const char *prefix, struct cbfs_file *last)
 
     dprintf(3, "Searching CBFS for prefix %s\n", prefix);
     int len = strlen(prefix);
+    cbfs_index_setup();
+    if (CBFSIndex) {
+        int i = 0;
+        if (last) {
+            struct cbfs_index_s *e = cbfs_index_find(last);
+            if (!e)
+                return NULL;
+            i = e - CBFSIndex + 1;
+        }
+        for (; i<CBFSIndexCount; i++)
+            if (memcmp(prefix, CBFSIndex[i].name, len) == 0)
+                return CBFSIndex[i].file;
+        return NULL;
+    }
     struct cbfs_file *file;
     if (! last)
         file = cbfs_getfirst();
@@ -377,10 +582,16 @@ cbfs_findprefix(const char *prefix, struct cbfs_file *last)
     return NULL;
 }
 
-// Find a file with the given filename (possibly with ".lzma" extension).
+// Find a file with the given filename (possibly with ".lzma" or ".lz4"
+// extension).
 struct cbfs_file *
 cbfs_finddatafile(const char *fname)
 {
+    if (!CONFIG_COREBOOT || !CONFIG_COREBOOT_FLASH)
+        return NULL;
+    cbfs_index_setup();
+    if (CBFSIndex)
+        return cbfs_index_lookup(fname, 1);
     int fnlen = strlen(fname);
     struct cbfs_file *file = NULL;
     for (;;) {
@@ -388,23 +599,31 @@ cbfs_finddatafile(const char *fname)
         if (!file)
             return NULL;
         if (file->filename[fnlen] == '\0'
-            || strcmp(&file->filename[fnlen], ".lzma") == 0)
+            || strcmp(&file->filename[fnlen], ".lzma") == 0
+            || strcmp(&file->filename[fnlen], ".lz4") == 0)
             return file;
     }
 }
 
-// Determine whether the file has a ".lzma" extension.
+// Determine the compression of a file from its extension.
 static int
 cbfs_iscomp(struct cbfs_file *file)
 {
-    int fnamelen = strlen(file->filename);
-    return fnamelen > 5 && strcmp(&file->filename[fnamelen-5], ".lzma") == 0;
+    struct cbfs_index_s *e = CBFSIndex ? cbfs_index_find(file) : NULL;
+    if (e)
+        return e->comp;
+    int comp;
+    cbfs_baselen(file->filename, strlen(file->filename), &comp);
+    return comp;
 }
 
 // Return the filename of a given file.
 const char *
 cbfs_filename(struct cbfs_file *file)
 {
+    struct cbfs_index_s *e = CBFSIndex ? cbfs_index_find(file) : NULL;
+    if (e)
+        return e->name;
     return file->filename;
 }
 
@@ -413,11 +632,32 @@ u32
 cbfs_datasize(struct cbfs_file *file)
 {
     void *src = (void*)file + ntohl(file->offset);
-    if (cbfs_iscomp(file))
+    switch (cbfs_iscomp(file)) {
+    case CBFS_COMPRESS_LZMA:
         return *(u32*)(src + LZMA_PROPERTIES_SIZE);
+    case CBFS_COMPRESS_LZ4: {
+        int size = ulz4f_size(src, ntohl(file->len));
+        return size < 0 ? 0 : size;
+    }
+    }
     return ntohl(file->len);
 }
 
+// Copy a block out of flash.  Uncached flash reads are very slow, so
+// the flash is cached for the duration of the copy when possible.
+static void
+cbfs_readflash(void *dst, const void *src, u32 len)
+{
+    int mtrr = mtrr_flash_cache(ntohl(CBHDR->romsize));
+    // Copy any unaligned leading bytes so the bulk reads are aligned.
+    u32 lead = -(u32)src & 3;
+    if (lead > len)
+        lead = len;
+    memcpy(dst, src, lead);
+    iomemcpy(dst + lead, src + lead, len - lead);
+    mtrr_flash_uncache(mtrr);
+}
+
 // Copy a file to memory (uncompressing if necessary)
 int
 cbfs_copyfile(struct cbfs_file *file, void *dst, u32 maxlen)
@@ -427,13 +667,22 @@ cbfs_copyfile(struct cbfs_file *file, void *dst, u32 maxlen)
 
     u32 size = ntohl(file->len);
     void *src = (void*)file + ntohl(file->offset);
-    if (cbfs_iscomp(file)) {
+    int comp = cbfs_iscomp(file);
+    if (comp == CBFS_COMPRESS_LZ4 && !CONFIG_LZ4) {
+        dprintf(1, "No support for lz4 file %s\n", file->filename);
+        return -1;
+    }
+    if (comp) {
         // Compressed - copy to temp ram and uncompress it.
         void *temp = malloc_tmphigh(size);
         if (!temp)
             return -1;
-        iomemcpy(temp, src, size);
-        int ret = ulzma(dst, maxlen, temp, size);
+        cbfs_readflash(temp, src, size);
+        int ret;
+        if (comp == CBFS_COMPRESS_LZ4)
+            ret = ulz4f(dst, maxlen, temp, size);
+        else
+            ret = ulzma(dst, maxlen, temp, size);
         yield();
         free(temp);
         return ret;
@@ -445,10 +694,37 @@ cbfs_copyfile(struct cbfs_file *file, void *dst, u32 maxlen)
         warn_noalloc();
         return -1;
     }
-    iomemcpy(dst, src, size);
+    cbfs_readflash(dst, src, size);
     return size;
 }
 
+// Copy the first 'len' bytes of a file to memory.  Compressed files
+// are only uncompressed as far as needed and are read directly from
+// flash, so this is cheap even for large files.
+int
+cbfs_copyhead(struct cbfs_file *file, void *dst, u32 len)
+{
+    if (!CONFIG_COREBOOT || !CONFIG_COREBOOT_FLASH || !file)
+        return -1;
+
+    void *src = (void*)file + ntohl(file->offset);
+    int comp = cbfs_iscomp(file);
+    if (comp == CBFS_COMPRESS_LZ4) {
+        // The frame may not record its size (cbfs_datasize() is then
+        // zero), but decoding stops at the end of the frame anyway.
+        if (!CONFIG_LZ4)
+            return -1;
+        return ulz4f_head(dst, len, src, ntohl(file->len));
+    }
+    u32 size = cbfs_datasize(file);
+    if (len > size)
+        len = size;
+    if (comp == CBFS_COMPRESS_LZMA)
+        return __ulzma(dst, len, src, ntohl(file->len));
+    iomemcpy(dst, src, len);
+    return len;
+}
+
 struct cbfs_payload_segment {
     u32 type;
     u32 compression;
@@ -461,9 +737,6 @@ struct cbfs_payload_segment {
 #define PAYLOAD_SEGMENT_BSS    0x20535342
 #define PAYLOAD_SEGMENT_ENTRY  0x52544E45
 
-#define CBFS_COMPRESS_NONE  0
-#define CBFS_COMPRESS_LZMA  1
-
 struct cbfs_payload {
     struct cbfs_payload_segment segments[1];
 };
@@ -476,6 +749,7 @@ cbfs_run_payload(struct cbfs_file *file)
     dprintf(1, "Run %s\n", file->filename);
     struct cbfs_payload *pay = (void*)file + ntohl(file->offset);
     struct cbfs_payload_segment *seg = pay->segments;
+    int mtrr = mtrr_flash_cache(ntohl(CBHDR->romsize));
     for (;;) {
         void *src = (void*)pay + ntohl(seg->offset);
         void *dest = (void*)ntohl((u32)seg->load_addr);
@@ -487,6 +761,7 @@ cbfs_run_payload(struct cbfs_file *file)
             memset(dest, 0, dest_len);
             break;
         case PAYLOAD_SEGMENT_ENTRY: {
+            mtrr_flash_uncache(mtrr);
             dprintf(1, "Calling addr %p\n", dest);
             void (*func)() = dest;
             func();
@@ -503,12 +778,18 @@ cbfs_run_payload(struct cbfs_file *file)
                        && seg->compression == htonl(CBFS_COMPRESS_LZMA)) {
                 int ret = ulzma(dest, dest_len, src, src_len);
                 if (ret < 0)
-                    return;
+                    goto fail;
+                src_len = ret;
+            } else if (CONFIG_LZ4
+                       && seg->compression == htonl(CBFS_COMPRESS_LZ4)) {
+                int ret = ulz4f(dest, dest_len, src, src_len);
+                if (ret < 0)
+                    goto fail;
                 src_len = ret;
             } else {
                 dprintf(1, "No support for compression type %x\n"
                         , seg->compression);
-                return;
+                goto fail;
             }
             if (dest_len > src_len)
                 memset(dest + src_len, 0, dest_len - src_len);
@@ -516,6 +797,8 @@ cbfs_run_payload(struct cbfs_file *file)
         }
         seg++;
     }
+fail:
+    mtrr_flash_uncache(mtrr);
 }
 
 // Register payloads in "img/" directory with boot system.
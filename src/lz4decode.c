@@ -0,0 +1,179 @@
+// LZ4 frame format decompression.
+//
+// Copyright (C) 2026  the SeaBIOS developers <seabios@seabios.org>
+//
+// This file may be distributed under the terms of the GNU LGPLv3 license.
+
+#include "util.h" // dprintf
+
+// LZ4 trades compression ratio for a decoder that is little more than
+// a memcpy loop - well suited to firmware on slow cpus with fast flash.
+// This decodes the frame format produced by the standard "lz4" tool.
+
+#define LZ4F_MAGIC 0x184D2204
+#define LZ4F_FLG_VERSION_MASK  0xc0
+#define LZ4F_FLG_VERSION       0x40
+#define LZ4F_FLG_BLOCK_CSUM    (1<<4)
+#define LZ4F_FLG_CONTENT_SIZE  (1<<3)
+#define LZ4F_FLG_DICTID        (1<<0)
+#define LZ4F_BLOCK_UNCOMPRESSED (1<<31)
+
+#define LZ4_MINMATCH 4
+
+// Read an lz4 length extension (a run of 255 bytes and a final byte).
+static const u8 *
+lz4_len(const u8 *src, const u8 *srcend, u32 *len)
+{
+    u8 b;
+    do {
+        if (src >= srcend)
+            return NULL;
+        b = *src++;
+        *len += b;
+    } while (b == 255);
+    return src;
+}
+
+// Decode one lz4 block to 'dst'.  Matches may reference any data
+// already written since 'dststart'.  Returns the new output position
+// or NULL on a corrupt block.  In 'partial' mode decoding stops (without
+// an error) once 'dstend' is reached.
+static u8 *
+lz4_block(u8 *dst, u8 *dststart, u8 *dstend, const u8 *src, const u8 *srcend
+          , int partial)
+{
+    while (src < srcend) {
+        u8 token = *src++;
+
+        // Literals
+        u32 len = token >> 4;
+        if (len == 15 && !(src = lz4_len(src, srcend, &len)))
+            return NULL;
+        if (len > srcend - src)
+            return NULL;
+        if (len > dstend - dst) {
+            if (!partial)
+                return NULL;
+            len = dstend - dst;
+        }
+        memcpy(dst, src, len);
+        dst += len;
+        src += len;
+        if (src >= srcend)
+            // The last sequence of a block has no match.
+            break;
+        if (partial && dst >= dstend)
+            break;
+
+        // Match
+        if (srcend - src < 2)
+            return NULL;
+        u32 offset = src[0] | (src[1] << 8);
+        src += 2;
+        if (!offset || offset > dst - dststart)
+            return NULL;
+        len = token & 0x0f;
+        if (len == 15 && !(src = lz4_len(src, srcend, &len)))
+            return NULL;
+        len += LZ4_MINMATCH;
+        if (len > dstend - dst) {
+            if (!partial)
+                return NULL;
+            len = dstend - dst;
+        }
+        const u8 *m = dst - offset;
+        if (offset >= sizeof(u32))
+            for (; len >= sizeof(u32); len -= sizeof(u32)) {
+                *(u32*)dst = *(u32*)m;
+                dst += sizeof(u32);
+                m += sizeof(u32);
+            }
+        while (len--)
+            *dst++ = *m++;
+    }
+    return dst;
+}
+
+static int
+__ulz4f(u8 *dst, u32 dstlen, const u8 *src, u32 srclen, int partial)
+{
+    const u8 *srcend = src + srclen;
+    if (srclen < 7 || *(u32*)src != LZ4F_MAGIC) {
+        dprintf(1, "Not an lz4 frame\n");
+        return -1;
+    }
+    u8 flg = src[4];
+    if ((flg & LZ4F_FLG_VERSION_MASK) != LZ4F_FLG_VERSION) {
+        dprintf(1, "Unsupported lz4 frame version (flags %x)\n", flg);
+        return -1;
+    }
+    const u8 *p = src + 6;
+    if (flg & LZ4F_FLG_CONTENT_SIZE)
+        p += 8;
+    if (flg & LZ4F_FLG_DICTID)
+        p += 4;
+    p++; // Header checksum
+
+    u8 *out = dst, *outend = dst + dstlen;
+    for (;;) {
+        if (srcend - p < 4)
+            goto fail;
+        u32 bsize = *(u32*)p;
+        p += 4;
+        if (!bsize)
+            // End mark
+            break;
+        u32 len = bsize & ~LZ4F_BLOCK_UNCOMPRESSED;
+        if (len > srcend - p)
+            goto fail;
+        if (bsize & LZ4F_BLOCK_UNCOMPRESSED) {
+            if (len > outend - out) {
+                if (!partial)
+                    goto fail;
+                len = outend - out;
+            }
+            memcpy(out, p, len);
+            out += len;
+        } else {
+            out = lz4_block(out, dst, outend, p, p + len, partial);
+            if (!out)
+                goto fail;
+        }
+        p += len;
+        if (flg & LZ4F_FLG_BLOCK_CSUM)
+            p += 4;
+        if (partial && out >= outend)
+            break;
+    }
+    return out - dst;
+fail:
+    dprintf(1, "lz4 data corrupt or too large (max %d)\n", dstlen);
+    return -1;
+}
+
+// Uncompress an lz4 frame.  Returns the uncompressed length.
+int
+ulz4f(u8 *dst, u32 maxlen, const u8 *src, u32 srclen)
+{
+    dprintf(3, "Uncompressing lz4 data %d@%p to %d@%p\n"
+            , srclen, src, maxlen, dst);
+    return __ulz4f(dst, maxlen, src, srclen, 0);
+}
+
+// Uncompress just the first 'len' bytes of an lz4 frame.
+int
+ulz4f_head(u8 *dst, u32 len, const u8 *src, u32 srclen)
+{
+    return __ulz4f(dst, len, src, srclen, 1);
+}
+
+// Return the uncompressed size recorded in an lz4 frame header (or -1
+// if the frame doesn't record it).
+int
+ulz4f_size(const u8 *src, u32 srclen)
+{
+    if (srclen < 15 || *(u32*)src != LZ4F_MAGIC
+        || !(src[4] & LZ4F_FLG_CONTENT_SIZE) || *(u32*)(src + 10))
+        return -1;
+    return *(u32*)(src + 6);
+}
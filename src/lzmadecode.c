@@ -51,11 +51,26 @@
   
 #define RC_GET_BIT(p, mi) RC_GET_BIT2(p, mi, ; , ;)               
 
+/* Branch free version of RC_GET_BIT.  The bits of literals and bit
+   trees are close to random, so computing both outcomes and selecting
+   with a mask is faster than a mispredicted branch. */
+#define RC_GET_BIT_BL(p, mi) { UInt32 pv = *(p), mask; RC_NORMALIZE; \
+  bound = (Range >> kNumBitModelTotalBits) * pv; \
+  mask = 0 - (UInt32)(Code >= bound); \
+  Range = (bound & ~mask) | ((Range - bound) & mask); \
+  Code -= bound & mask; \
+  *(p) = (CProb)(((pv + ((kBitModelTotal - pv) >> kNumMoveBits)) & ~mask) \
+                 | ((pv - (pv >> kNumMoveBits)) & mask)); \
+  mi = (mi + mi) + (mask & 1); }
+
 #define RangeDecoderBitTreeDecode(probs, numLevels, res) \
   { int i = numLevels; res = 1; \
-  do { CProb *cp = probs + res; RC_GET_BIT(cp, res) } while(--i != 0); \
+  do { CProb *cp = probs + res; RC_GET_BIT_BL(cp, res) } while(--i != 0); \
   res -= (1 << numLevels); }
 
+/* Word sized access to the output buffer for match copies. */
+typedef UInt32 __attribute__((may_alias)) UInt32A;
+
 
 #define kNumPosBitsMax 4
 #define kNumPosStatesMax (1 << kNumPosBitsMax)
@@ -203,7 +218,7 @@ int LzmaDecode(CLzmaDecoderState *vs,
       while (symbol < 0x100)
       {
         CProb *probLit = prob + symbol;
-        RC_GET_BIT(probLit, symbol)
+        RC_GET_BIT_BL(probLit, symbol)
       }
       previousByte = (Byte)symbol;
 
@@ -380,13 +395,23 @@ int LzmaDecode(CLzmaDecoderState *vs,
         return LZMA_RESULT_DATA_ERROR;
 
 
-      do
       {
-        previousByte = outStream[nowPos - rep0];
-        len--;
-        outStream[nowPos++] = previousByte;
+        /* Bulk copy the match - a word at a time when the source
+           doesn't overlap the bytes being written. */
+        SizeT n = outSize - nowPos;
+        Byte *dst = outStream + nowPos;
+        const Byte *src = dst - rep0;
+        if (n > (SizeT)len)
+          n = len;
+        nowPos += n;
+        len -= n;
+        if (rep0 >= 4)
+          for (; n >= 4; n -= 4, dst += 4, src += 4)
+            *(UInt32A*)dst = *(const UInt32A*)src;
+        for (; n != 0; n--)
+          *dst++ = *src++;
+        previousByte = dst[-1];
       }
-      while(len != 0 && nowPos < outSize);
     }
   }
   RC_NORMALIZE;
@@ -13,31 +13,104 @@
  * e820 memory map
  ****************************************************************/
 
-// Remove an entry from the e820_list.
-static void
-remove_e820(int i)
+// Number of entries the current e820_list buffer can hold.
+static int e820_capacity;
+
+// Before malloc_setup() the map may outgrow the f-segment buffer while
+// the firmware provided map is read.  It then moves to the top of the
+// temporary low memory area (which isn't used until malloc_setup) and
+// is moved to malloc'd memory by memmap_malloc_setup().
+#define E820_EARLY_MAX 512
+#define E820_EARLY_ADDR \
+    (BUILD_EBDA_MINIMUM - E820_EARLY_MAX * sizeof(struct e820entry))
+static int e820_malloc_ready;
+
+// Make sure the e820_list has room for 'extra' more entries.  The map
+// starts out in the f-segment and is moved elsewhere if it outgrows
+// that buffer.
+static int
+grow_e820(int extra)
 {
-    e820_count--;
-    memmove(&e820_list[i], &e820_list[i+1]
-            , sizeof(e820_list[0]) * (e820_count - i));
+    if (!e820_list) {
+        e820_list = e820_initial;
+        e820_capacity = CONFIG_MAX_E820;
+    }
+    int want = e820_count + extra;
+    if (want <= e820_capacity)
+        return 0;
+    struct e820entry *n;
+    int newcap;
+    if (!e820_malloc_ready) {
+        n = (void*)E820_EARLY_ADDR;
+        newcap = E820_EARLY_MAX;
+        if (want > newcap)
+            return -1;
+    } else {
+        newcap = e820_capacity * 2;
+        while (newcap < want)
+            newcap *= 2;
+        n = malloc_tmphigh(sizeof(n[0]) * newcap);
+        if (!n)
+            return -1;
+    }
+    memcpy(n, e820_list, sizeof(n[0]) * e820_count);
+    if (e820_list != e820_initial && e820_list != (void*)E820_EARLY_ADDR)
+        free(e820_list);
+    e820_list = n;
+    e820_capacity = newcap;
+    return 0;
 }
 
-// Insert an entry in the e820_list at the given position.
-static void
-insert_e820(int i, u64 start, u64 size, u32 type)
+// Called by malloc_setup() once temporary high memory is available and
+// before the temporary low memory area is handed out.
+void
+memmap_malloc_setup(void)
 {
-    if (e820_count >= CONFIG_MAX_E820) {
-        warn_noalloc();
+    e820_malloc_ready = 1;
+    if (e820_list != (void*)E820_EARLY_ADDR)
         return;
+    struct e820entry *n = malloc_tmphigh(sizeof(n[0]) * e820_capacity);
+    if (!n) {
+        warn_noalloc();
+        // Keep what fits in the f-segment buffer.
+        n = e820_initial;
+        e820_capacity = CONFIG_MAX_E820;
+        if (e820_count > e820_capacity)
+            e820_count = e820_capacity;
     }
+    memcpy(n, e820_list, sizeof(n[0]) * e820_count);
+    e820_list = n;
+}
 
-    memmove(&e820_list[i+1], &e820_list[i]
-            , sizeof(e820_list[0]) * (e820_count - i));
-    e820_count++;
-    struct e820entry *e = &e820_list[i];
-    e->start = start;
-    e->size = size;
-    e->type = type;
+// Find the first entry that ends at or after 'pos'.
+static int
+find_e820(u64 pos)
+{
+    int lo = 0, hi = e820_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        struct e820entry *e = &e820_list[mid];
+        if (e->start + e->size < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Find the first entry that starts after 'pos'.
+static int
+find_e820_after(int lo, u64 pos)
+{
+    int hi = e820_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (e820_list[mid].start <= pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
 }
 
 static const char *
@@ -70,8 +143,8 @@ dump_map(void)
     }
 }
 
-// Add a new entry to the list.  This scans for overlaps and keeps the
-// list sorted.
+// Add a new entry to the list.  The list is kept sorted, and adjacent
+// entries of the same type are coalesced.
 void
 add_e820(u64 start, u64 size, u32 type)
 {
@@ -80,62 +153,247 @@ add_e820(u64 start, u64 size, u32 type)
     if (! size)
         // Huh?  Nothing to do.
         return;
+    if (!e820_list)
+        grow_e820(0);
 
-    // Find position of new item (splitting existing item if needed).
+    // Entries [lo, hi) overlap or touch the new range.
     u64 end = start + size;
-    int i;
-    for (i=0; i<e820_count; i++) {
-        struct e820entry *e = &e820_list[i];
-        u64 e_end = e->start + e->size;
-        if (start > e_end)
-            continue;
-        // Found position - check if an existing item needs to be split.
-        if (start > e->start) {
-            if (type == e->type) {
+    int lo = find_e820(start);
+    int hi = find_e820_after(lo, end);
+
+    // Build the replacement for those entries (at most 3 items).
+    struct e820entry pieces[3], *p = pieces;
+    struct e820entry right = { 0, 0, 0 };
+    if (lo < hi) {
+        struct e820entry *first = &e820_list[lo], *last = &e820_list[hi-1];
+        u64 last_end = last->start + last->size;
+        if (first->start < start) {
+            if (first->type == type) {
                 // Same type - merge them.
-                size += start - e->start;
-                start = e->start;
+                start = first->start;
+            } else {
+                // Keep the part of the existing item before the new one.
+                p->start = first->start;
+                p->size = start - first->start;
+                p->type = first->type;
+                p++;
+            }
+        }
+        if (last_end > end) {
+            if (last->type == type) {
+                end = last_end;
             } else {
-                // Split existing item.
-                e->size = start - e->start;
-                i++;
-                if (e_end > end)
-                    insert_e820(i, end, e_end - end, e->type);
+                right.start = end;
+                right.size = last_end - end;
+                right.type = last->type;
             }
         }
-        break;
     }
-    // Remove/adjust existing items that are overlapping.
-    while (i<e820_count) {
-        struct e820entry *e = &e820_list[i];
-        if (end < e->start)
-            // No overlap - done.
-            break;
-        u64 e_end = e->start + e->size;
-        if (end >= e_end) {
-            // Existing item completely overlapped - remove it.
-            remove_e820(i);
-            continue;
+    if (type != E820_HOLE) {
+        p->start = start;
+        p->size = end - start;
+        p->type = type;
+        p++;
+    }
+    if (right.size)
+        *p++ = right;
+
+    int count = p - pieces;
+    if (count > hi - lo && grow_e820(count - (hi - lo))) {
+        warn_noalloc();
+        return;
+    }
+    memmove(&e820_list[lo + count], &e820_list[hi]
+            , sizeof(e820_list[0]) * (e820_count - hi));
+    memcpy(&e820_list[lo], pieces, sizeof(pieces[0]) * count);
+    e820_count += count - (hi - lo);
+    //dump_map();
+}
+
+// Append a range to the e820_list, merging it with the last entry if
+// they are adjacent and of the same type.
+static void
+emit_e820(u64 start, u64 end, u32 type)
+{
+    if (end <= start)
+        return;
+    if (e820_count) {
+        struct e820entry *last = &e820_list[e820_count-1];
+        if (last->type == type && last->start + last->size == start) {
+            last->size = end - last->start;
+            return;
         }
-        // Not completely overlapped - adjust its start.
-        e->start = end;
-        e->size = e_end - end;
-        if (type == e->type) {
-            // Same type - merge them.
-            size += e->size;
-            remove_e820(i);
+    }
+    struct e820entry *e = &e820_list[e820_count++];
+    e->start = start;
+    e->size = end - start;
+    e->type = type;
+}
+
+// Overlay a sorted list of non-overlapping ranges onto the map in one
+// pass.  The existing entries are first moved to the end of the
+// buffer and then merged back from the front - each new range adds at
+// most one item (two if it splits an existing item), so the buffer
+// must have room for e820_count + count + splits entries.
+static void
+overlay_e820(struct e820entry *list, int count)
+{
+    int na = e820_count, i = 0, j, have = 0;
+    struct e820entry *old = &e820_list[e820_capacity - na], cur;
+    memmove(old, e820_list, sizeof(old[0]) * na);
+    e820_count = 0;
+    for (j=0; j<count; j++) {
+        u64 start = list[j].start, end = start + list[j].size;
+        for (;;) {
+            if (!have) {
+                if (i >= na)
+                    break;
+                cur = old[i++];
+                have = 1;
+            }
+            u64 cur_end = cur.start + cur.size;
+            if (cur.start >= end)
+                break;
+            if (cur.start < start)
+                emit_e820(cur.start, cur_end < start ? cur_end : start
+                          , cur.type);
+            if (cur_end > end) {
+                // Keep the tail for the next new range.
+                cur.start = end;
+                cur.size = cur_end - end;
+                break;
+            }
+            have = 0;
         }
-        break;
+        if (list[j].type != E820_HOLE)
+            emit_e820(start, end, list[j].type);
     }
-    // Insert new item.
-    if (type != E820_HOLE)
-        insert_e820(i, start, size, type);
-    //dump_map();
+    if (have)
+        emit_e820(cur.start, cur.start + cur.size, cur.type);
+    for (; i<na; i++)
+        emit_e820(old[i].start, old[i].start + old[i].size, old[i].type);
 }
 
-// Report on final memory locations.
+static void
+sift_e820(struct e820entry *list, int root, int count)
+{
+    for (;;) {
+        int child = root*2 + 1;
+        if (child >= count)
+            return;
+        if (child+1 < count && list[child+1].start > list[child].start)
+            child++;
+        if (list[root].start >= list[child].start)
+            return;
+        struct e820entry t = list[root];
+        list[root] = list[child];
+        list[child] = t;
+        root = child;
+    }
+}
+
+// Heap sort a list of entries by start address.
+static void
+sort_e820(struct e820entry *list, int count)
+{
+    int i;
+    for (i=count/2-1; i>=0; i--)
+        sift_e820(list, i, count);
+    for (i=count-1; i>0; i--) {
+        struct e820entry t = list[0];
+        list[0] = list[i];
+        list[i] = t;
+        sift_e820(list, 0, i);
+    }
+}
+
+// Count the new ranges that fall strictly inside an existing entry.
+// Each new range adds at most one item to the map, except these which
+// split an existing item in two.
+static int
+count_e820_splits(struct e820entry *list, int count)
+{
+    int i, splits = 0;
+    for (i=0; i<count; i++) {
+        u64 start = list[i].start, end = start + list[i].size;
+        int pos = find_e820(start);
+        if (pos >= e820_count)
+            break;
+        struct e820entry *e = &e820_list[pos];
+        if (e->start < start && e->start + e->size > end)
+            splits++;
+    }
+    return splits;
+}
+
+// Add several entries to the map at once.  The entries override any
+// existing ranges they overlap.  The passed list is sorted in place, so
+// ranges that overlap each other are applied in address order.
+void
+add_e820_list(struct e820entry *list, int count)
+{
+    int i;
+    for (i=1; i<count; i++)
+        if (list[i].start < list[i-1].start + list[i-1].size)
+            break;
+    if (i < count) {
+        // Not already sorted - sort and check for overlaps.
+        sort_e820(list, count);
+        for (i=1; i<count; i++)
+            if (list[i].start < list[i-1].start + list[i-1].size)
+                break;
+    }
+    if (i < count || grow_e820(count + count_e820_splits(list, count))) {
+        // Overlapping ranges (or no room) - fall back to individual adds.
+        for (i=0; i<count; i++)
+            add_e820(list[i].start, list[i].size, list[i].type);
+        return;
+    }
+    overlay_e820(list, count);
+}
+
+// Room left for the final reservations made by malloc_finalize() (two
+// add_e820 calls, each of which may split an entry).
+#define E820_FINAL_EXTRA 4
+
+// Move the map to its final location.  The int 15/e820 handler can
+// only reach memory under 1Meg.
 void
 memmap_finalize(void)
+{
+    if (!e820_list)
+        return;
+    int count = e820_count;
+    if (e820_list == e820_initial
+        && count + E820_FINAL_EXTRA <= CONFIG_MAX_E820)
+        return;
+    struct e820entry *old = e820_list, *n = e820_initial;
+    e820_capacity = CONFIG_MAX_E820;
+    if (count + E820_FINAL_EXTRA > CONFIG_MAX_E820) {
+        e820_capacity = count + E820_FINAL_EXTRA;
+        n = malloc_fseg(sizeof(n[0]) * e820_capacity);
+        if (!n)
+            n = malloc_low(sizeof(n[0]) * e820_capacity);
+        if (!n) {
+            warn_noalloc();
+            n = e820_initial;
+            e820_capacity = CONFIG_MAX_E820;
+            if (count > CONFIG_MAX_E820)
+                count = CONFIG_MAX_E820;
+        }
+    }
+    if (n == old)
+        return;
+    memcpy(n, old, sizeof(n[0]) * count);
+    e820_list = n;
+    e820_count = count;
+    if (old != e820_initial)
+        free(old);
+}
+
+// Report on final memory locations.
+void
+memmap_report(void)
 {
     dump_map();
 }
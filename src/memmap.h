@@ -17,7 +17,10 @@ struct e820entry {
 };
 
 void add_e820(u64 start, u64 size, u32 type);
+void add_e820_list(struct e820entry *list, int count);
+void memmap_malloc_setup(void);
 void memmap_finalize(void);
+void memmap_report(void);
 
 // A typical OS page size
 #define PAGE_SIZE 4096
@@ -25,7 +28,8 @@ void memmap_finalize(void);
 #define PAGE_SHIFT 12
 
 // e820 map storage (defined in system.c)
-extern struct e820entry e820_list[];
+extern struct e820entry e820_initial[];
+extern struct e820entry *e820_list;
 extern int e820_count;
 
 // Space for exported bios tables (defined in misc.c)
@@ -7,6 +7,7 @@
 #include "util.h" // dprintf
 #include "biosvar.h" // GET_EBDA
 #include "xen.h" // usingXen
+#include "bregs.h" // CR0_CD
 
 #define MSR_MTRRcap                    0x000000fe
 #define MSR_MTRRfix64K_00000           0x00000250
@@ -31,12 +32,30 @@
 #define MTRR_MEMTYPE_WP 5
 #define MTRR_MEMTYPE_WB 6
 
+#define MTRR_DEF_TYPE_E  0x800
+#define MTRR_PHYS_MASK_VALID 0x800
+
+// Determine the mask of valid physical address bits.
+static u64
+mtrr_physmask(void)
+{
+    u32 eax, ebx, ecx, edx;
+    int phys_bits = 36;
+    cpuid(0x80000000u, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000008) {
+            /* Get physical bits from leaf 0x80000008 (if available) */
+            cpuid(0x80000008u, &eax, &ebx, &ecx, &edx);
+            phys_bits = eax & 0xff;
+    }
+    return ((1ull << phys_bits) - 1);
+}
+
 void mtrr_setup(void)
 {
     if (!CONFIG_MTRR_INIT || CONFIG_COREBOOT || usingXen())
         return;
 
-    u32 eax, ebx, ecx, edx, cpuid_features;
+    u32 eax, ebx, ecx, cpuid_features;
     cpuid(1, &eax, &ebx, &ecx, &cpuid_features);
     if (!(cpuid_features & CPUID_MTRR))
         return;
@@ -81,14 +100,7 @@ void mtrr_setup(void)
     }
 
     // Set variable MTRRs
-    int phys_bits = 36;
-    cpuid(0x80000000u, &eax, &ebx, &ecx, &edx);
-    if (eax >= 0x80000008) {
-            /* Get physical bits from leaf 0x80000008 (if available) */
-            cpuid(0x80000008u, &eax, &ebx, &ecx, &edx);
-            phys_bits = eax & 0xff;
-    }
-    u64 phys_mask = ((1ull << phys_bits) - 1);
+    u64 phys_mask = mtrr_physmask();
     for (i=0; i<vcnt; i++) {
         wrmsr_smp(MTRRphysBase_MSR(i), 0);
         wrmsr_smp(MTRRphysMask_MSR(i), 0);
@@ -101,3 +113,88 @@ void mtrr_setup(void)
     // Enable fixed and variable MTRRs; set default type.
     wrmsr_smp(MSR_MTRRdefType, 0xc00 | MTRR_MEMTYPE_WB);
 }
+
+
+/****************************************************************
+ * Flash read caching
+ ****************************************************************/
+
+// Program a variable MTRR on the boot cpu (following the update
+// sequence in the Intel SDM).  The other cpus are parked during POST
+// and never touch the ranges changed here.
+static void
+mtrr_update_var(int reg, u64 base, u64 mask)
+{
+    u32 cr0 = getcr0();
+    setcr0((cr0 | CR0_CD) & ~CR0_NW);
+    wbinvd();
+    u64 deftype = rdmsr(MSR_MTRRdefType);
+    wrmsr(MSR_MTRRdefType, deftype & ~MTRR_DEF_TYPE_E);
+    wrmsr(MTRRphysBase_MSR(reg), base);
+    wrmsr(MTRRphysMask_MSR(reg), mask);
+    wbinvd();
+    wrmsr(MSR_MTRRdefType, deftype);
+    setcr0(cr0);
+}
+
+// Temporarily mark the top 'size' bytes below 4GB (where the flash
+// chip is mapped) as write-protect cacheable.  Returns the variable
+// MTRR used, or -1 if the range was left unchanged.
+int
+mtrr_flash_cache(u32 size)
+{
+    if (!CONFIG_FLASH_CACHE || usingXen())
+        return -1;
+    u32 eax, ebx, ecx, cpuid_features;
+    cpuid(1, &eax, &ebx, &ecx, &cpuid_features);
+    if (!(cpuid_features & CPUID_MTRR) || !(cpuid_features & CPUID_MSR))
+        return -1;
+    u64 deftype = rdmsr(MSR_MTRRdefType);
+    if (!(deftype & MTRR_DEF_TYPE_E))
+        // MTRRs disabled - don't enable them for just the flash.
+        return -1;
+
+    // MTRR ranges must be a naturally aligned power of two.
+    u32 cachesize = 4096;
+    while (cachesize && cachesize < size)
+        cachesize <<= 1;
+    if (!cachesize)
+        return -1;
+    u64 base = -cachesize, phys_mask = mtrr_physmask();
+
+    // Leave the range alone if an existing MTRR covers it (it is either
+    // already cached, or marked uncached which would take precedence),
+    // and look for a free variable MTRR.
+    int vcnt = rdmsr(MSR_MTRRcap) & 0xff;
+    int i, reg = -1;
+    for (i=0; i<vcnt; i++) {
+        u64 mask = rdmsr(MTRRphysMask_MSR(i));
+        if (!(mask & MTRR_PHYS_MASK_VALID)) {
+            if (reg < 0)
+                reg = i;
+            continue;
+        }
+        mask &= phys_mask & ~0xfffULL;
+        u64 vbase = rdmsr(MTRRphysBase_MSR(i)) & phys_mask & ~0xfffULL;
+        if (((vbase ^ base) & mask & -(u64)cachesize) == 0)
+            return -1;
+    }
+    if ((deftype & 0xff) != MTRR_MEMTYPE_UC || reg < 0)
+        // Already cached by default, or no free MTRR.
+        return -1;
+
+    dprintf(3, "Caching flash %x-%x with mtrr %d\n"
+            , (u32)base, (u32)base + cachesize - 1, reg);
+    mtrr_update_var(reg, base | MTRR_MEMTYPE_WP
+                    , (-(u64)cachesize & phys_mask) | MTRR_PHYS_MASK_VALID);
+    return reg;
+}
+
+// Undo a mtrr_flash_cache() call.
+void
+mtrr_flash_uncache(int reg)
+{
+    if (!CONFIG_FLASH_CACHE || reg < 0)
+        return;
+    mtrr_update_var(reg, 0, 0);
+}
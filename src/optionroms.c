@@ -6,6 +6,7 @@
 // This file may be distributed under the terms of the GNU LGPLv3 license.
 
 #include "bregs.h" // struct bregs
+#include "biosvar.h" // GET_BDA
 #include "farptr.h" // FLATPTR_TO_SEG
 #include "config.h" // CONFIG_*
 #include "util.h" // dprintf
@@ -235,6 +236,176 @@ getRomPriority(u64 *sources, struct rom_header *rom, int instance)
 }
 
 
+/****************************************************************
+ * Option rom cache
+ ****************************************************************/
+
+// Roms that have run their init code are saved in RomCacheSpace so
+// that a warm reboot can restore them instead of running them again.
+// Entries are only reused in order - once a rom differs from its
+// saved copy the rest of the cache is rebuilt.
+
+#define ROMCACHE_SIGNATURE 0x43524f4d // MORC
+#define ROMCACHE_FILE    (1<<0)
+#define ROMCACHE_NOCACHE (1<<1)
+
+struct romcache_entry_s {
+    u32 id;
+    u16 bdf, flags;
+    u32 addr, romsize, romsum;
+    u32 data, size;
+};
+
+struct romcache_s {
+    u32 signature;
+    u32 self;
+    u32 sum;
+    u32 len;
+    u32 count;
+    struct romcache_entry_s entries[32];
+};
+
+// Address of the rom cache if it was found intact on a warm reset.
+u32 RomCachePrev;
+
+static struct romcache_s *RomCache;
+static int RomCacheMatch;
+static u32 RomCacheEnd;
+
+static u32
+romcache_sum(void *buf, u32 len)
+{
+    u32 *p = buf, sum = len;
+    for (; len >= sizeof(u32); len -= sizeof(u32))
+        sum = (sum * 33) ^ *p++;
+    return sum;
+}
+
+// Verify the rom cache is intact (called on a warm reset).
+u32
+optionrom_cache_check(void)
+{
+    struct romcache_s *rc = RomCacheSpace;
+    if (!CONFIG_OPTIONROM_CACHE || !rc)
+        return 0;
+    u32 hdr = offsetof(struct romcache_s, len);
+    if (rc->signature != ROMCACHE_SIGNATURE || rc->self != (u32)rc
+        || rc->len < sizeof(*rc) || rc->len > CONFIG_MAX_ROMCACHE
+        || rc->sum != romcache_sum(&rc->len, rc->len - hdr))
+        return 0;
+    return (u32)rc;
+}
+
+// Return a signature of the state an option rom init may modify.
+static u32
+romcache_state(void)
+{
+    u32 sum = romcache_sum(MAKE_FLATPTR(SEG_IVT, 0), sizeof(struct rmode_IVT));
+    sum = (sum * 33) ^ GET_BDA(equipment_list_flags);
+    sum = (sum * 33) ^ GET_BDA(mem_size_kb);
+    sum = (sum * 33) ^ GET_BDA(ebda_seg);
+    sum = (sum * 33) ^ GET_BDA(hdcount);
+    return (sum * 33) ^ malloc_count();
+}
+
+static void
+romcache_setup(void)
+{
+    if (!CONFIG_OPTIONROM_CACHE || !RomCacheSpace)
+        return;
+    struct romcache_s *rc = RomCache = RomCacheSpace;
+    RomCacheMatch = 0;
+    if (RomCachePrev == (u32)rc) {
+        RomCacheMatch = rc->count;
+        dprintf(1, "Found option rom cache (%d roms)\n", RomCacheMatch);
+    }
+    // Invalidate the cache while it is being rebuilt.
+    rc->signature = 0;
+    rc->count = 0;
+    RomCacheEnd = sizeof(*rc);
+}
+
+static void
+romcache_finalize(void)
+{
+    struct romcache_s *rc = RomCache;
+    if (!CONFIG_OPTIONROM_CACHE || !rc)
+        return;
+    u32 hdr = offsetof(struct romcache_s, len);
+    rc->self = (u32)rc;
+    rc->len = RomCacheEnd;
+    rc->sum = romcache_sum(&rc->len, rc->len - hdr);
+    rc->signature = ROMCACHE_SIGNATURE;
+    RomCache = NULL;
+}
+
+// Run rom init code, or restore the result of a previous run from the
+// option rom cache.
+static int
+init_cached_optionrom(struct rom_header *rom, u16 bdf, int isvga, u64 source)
+{
+    struct romcache_s *rc = RomCache;
+    if (!CONFIG_OPTIONROM_CACHE || !rc || isvga)
+        return init_optionrom(rom, bdf, isvga);
+    if (! is_valid_rom(rom))
+        return -1;
+    if (rc->count >= ARRAY_SIZE(rc->entries)) {
+        RomCacheMatch = 0;
+        return init_optionrom(rom, bdf, isvga);
+    }
+
+    u32 id = source, flags = ROMCACHE_FILE;
+    if (source & RS_PCIROM) {
+        struct pci_device *pci = (void*)(u32)source;
+        id = (pci->device << 16) | pci->vendor;
+        flags = 0;
+    }
+    u32 romsize = rom->size * 512;
+    u32 romsum = romcache_sum(rom, romsize);
+    struct romcache_entry_s *e = &rc->entries[rc->count++];
+    int match = (rc->count <= RomCacheMatch && e->id == id && e->bdf == bdf
+                 && (e->flags & ROMCACHE_FILE) == flags
+                 && e->addr == (u32)rom && e->romsize == romsize
+                 && e->romsum == romsum);
+    if (match && !(e->flags & ROMCACHE_NOCACHE)) {
+        dprintf(1, "Restoring option rom at %p from cache\n", rom);
+        memcpy(rom, (void*)rc + e->data, e->size);
+        RomEnd = (u32)rom + e->size;
+        RomCacheEnd = e->data + e->size;
+        return 0;
+    }
+    if (!match)
+        RomCacheMatch = 0;
+
+    u32 state = romcache_state();
+    if (get_pnp_rom(rom))
+        callrom(rom, bdf);
+    u32 size = ALIGN(rom->size * 512, OPTION_ROM_ALIGN);
+    RomEnd = (u32)rom + size;
+
+    e->id = id;
+    e->bdf = bdf;
+    e->flags = flags;
+    e->addr = (u32)rom;
+    e->romsize = romsize;
+    e->romsum = romsum;
+    e->data = RomCacheEnd;
+    e->size = 0;
+    if (romcache_state() != state || RomCacheEnd + size > CONFIG_MAX_ROMCACHE) {
+        // Rom init changed the system state - it must run on each boot.
+        dprintf(3, "Option rom at %p can not be cached\n", rom);
+        e->flags |= ROMCACHE_NOCACHE;
+        return 0;
+    }
+    // The saved copy shifts the data of any following entries.
+    RomCacheMatch = 0;
+    e->size = size;
+    memcpy((void*)rc + RomCacheEnd, rom, size);
+    RomCacheEnd += size;
+    return 0;
+}
+
+
 /****************************************************************
  * Roms in CBFS
  ****************************************************************/
@@ -253,6 +424,55 @@ lookup_hardcode(struct pci_device *pci)
     return (void*)RomEnd;
 }
 
+static int MatchFileRoms;
+
+// Inspect the headers of a rom file and return true if it can't be
+// used on this machine.  This avoids copying (and uncompressing) roms
+// for pci devices that aren't present.
+static int
+skip_file_rom(u32 file)
+{
+    u8 buf[512];
+    struct rom_header *rom = (void*)buf;
+    int len = romfile_copyhead(file, buf, sizeof(buf));
+    if (len < (int)sizeof(*rom) || rom->signature != OPTION_ROM_SIGNATURE
+        || !rom->size) {
+        dprintf(4, "Skipping file %s - not an option rom\n", romfile_name(file));
+        return 1;
+    }
+    if (rom->pcioffset + sizeof(struct pci_data) > len)
+        // Pci header not in the inspected area.
+        return 0;
+    struct pci_data *pd = get_pci_rom(rom);
+    if (!pd)
+        return 0;
+    if (pd->type != PCIROM_CODETYPE_X86 && pd->indicator & 0x80) {
+        dprintf(4, "Skipping file %s - no x86 image (type %d)\n"
+                , romfile_name(file), pd->type);
+        return 1;
+    }
+    if (MatchFileRoms && !pci_find_device(pd->vendor, pd->device)) {
+        dprintf(4, "Skipping file %s - no device %04x:%04x\n"
+                , romfile_name(file), pd->vendor, pd->device);
+        return 1;
+    }
+    return 0;
+}
+
+// Deploy and run the rom in a given CBFS file.
+static void
+init_file_rom(u32 file, int isvga, u64 *sources)
+{
+    if (skip_file_rom(file))
+        return;
+    struct rom_header *rom = (void*)RomEnd;
+    int ret = romfile_copy(file, rom, max_rom() - RomEnd);
+    if (ret > 0) {
+        setRomSource(sources, rom, file);
+        init_cached_optionrom(rom, 0, isvga, file);
+    }
+}
+
 // Run all roms in a given CBFS directory.
 static void
 run_file_roms(const char *prefix, int isvga, u64 *sources)
@@ -262,12 +482,7 @@ run_file_roms(const char *prefix, int isvga, u64 *sources)
         file = romfile_findprefix(prefix, file);
         if (!file)
             break;
-        struct rom_header *rom = (void*)RomEnd;
-        int ret = romfile_copy(file, rom, max_rom() - RomEnd);
-        if (ret > 0) {
-            setRomSource(sources, rom, file);
-            init_optionrom(rom, 0, isvga);
-        }
+        init_file_rom(file, isvga, sources);
     }
 }
 
@@ -380,7 +595,7 @@ init_pcirom(struct pci_device *pci, int isvga, u64 *sources)
         // No ROM present.
         return -1;
     setRomSource(sources, rom, RS_PCIROM | (u32)pci);
-    return init_optionrom(rom, bdf, isvga);
+    return init_cached_optionrom(rom, bdf, isvga, RS_PCIROM | (u32)pci);
 }
 
 
@@ -388,6 +603,71 @@ init_pcirom(struct pci_device *pci, int isvga, u64 *sources)
  * Non-VGA option rom init
  ****************************************************************/
 
+// A rom to deploy - either the rom of a pci device or a CBFS file.
+struct romplan_s {
+    struct pci_device *pci;
+    u32 file;
+    int prio;
+};
+
+// Add a rom to the plan keeping it sorted by boot priority.  Roms
+// without a priority keep their discovery order after all the others.
+static void
+plan_add(struct romplan_s *plan, int n, struct pci_device *pci, u32 file
+         , int prio)
+{
+    while (n && (u32)plan[n-1].prio > (u32)prio) {
+        plan[n] = plan[n-1];
+        n--;
+    }
+    plan[n].pci = pci;
+    plan[n].file = file;
+    plan[n].prio = prio;
+}
+
+// Deploy the pci and CBFS roms in boot priority order.  Each rom is
+// placed at RomEnd and the space it releases during init is reused by
+// the next one, so when the rom area fills up it is the roms least
+// likely to be booted that are left out.
+static void
+deploy_roms(u64 *sources)
+{
+    int count = 0;
+    struct pci_device *pci;
+    foreachpci(pci)
+        count++;
+    u32 file = 0;
+    while ((file = romfile_findprefix("genroms/", file)))
+        count++;
+    if (!count)
+        return;
+    struct romplan_s *plan = malloc_tmp(count * sizeof(plan[0]));
+    if (!plan) {
+        warn_noalloc();
+        return;
+    }
+
+    int n = 0;
+    foreachpci(pci) {
+        if (pci->class == PCI_CLASS_DISPLAY_VGA || pci->have_driver)
+            continue;
+        plan_add(plan, n++, pci, 0, bootprio_find_pci_device(pci));
+    }
+    while ((file = romfile_findprefix("genroms/", file)))
+        plan_add(plan, n++, NULL, file
+                 , bootprio_find_named_rom(romfile_name(file), 0));
+
+    int i;
+    for (i=0; i<n; i++) {
+        dprintf(5, "Deploying rom %d (prio %d)\n", i, plan[i].prio);
+        if (plan[i].pci)
+            init_pcirom(plan[i].pci, 0, sources);
+        else
+            init_file_rom(plan[i].file, 0, sources);
+    }
+    free(plan);
+}
+
 void
 optionrom_setup(void)
 {
@@ -410,16 +690,13 @@ optionrom_setup(void)
                 pos = RomEnd;
         }
     } else {
-        // Find and deploy PCI roms.
-        struct pci_device *pci;
-        foreachpci(pci) {
-            if (pci->class == PCI_CLASS_DISPLAY_VGA || pci->have_driver)
-                continue;
-            init_pcirom(pci, 0, sources);
-        }
+        romcache_setup();
+
+        // Find and deploy PCI roms and CBFS roms not associated with
+        // a device.
+        deploy_roms(sources);
 
-        // Find and deploy CBFS roms not associated with a device.
-        run_file_roms("genroms/", 0, sources);
+        romcache_finalize();
     }
 
     // All option roms found and deployed - now build BEV/BCV vectors.
@@ -475,6 +752,7 @@ vga_setup(void)
 
     // Load some config settings that impact VGA.
     EnforceChecksum = romfile_loadint("etc/optionroms-checksum", 1);
+    MatchFileRoms = romfile_loadint("etc/optionroms-match-device", 1);
     S3ResumeVgaInit = romfile_loadint("etc/s3-resume-vga-init", 0);
     ScreenAndDebug = romfile_loadint("etc/screen-and-debug", 1);
 
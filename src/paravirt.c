@@ -168,32 +168,101 @@ struct smbios_table {
 #define SMBIOS_FIELD_ENTRY 0
 #define SMBIOS_TABLE_ENTRY 1
 
-size_t qemu_cfg_smbios_load_field(int type, size_t offset, void *addr)
+// In-memory copy of an smbios fw_cfg entry.
+struct smbios_cfg_entry {
+    struct smbios_cfg_entry *next;
+    u16 length;
+    u16 offset;
+    u8 data[];
+};
+
+// Lists of the smbios fw_cfg entries (in fw_cfg order) indexed by
+// smbios type - field overrides first, then full tables.
+static struct smbios_cfg_entry **SmbiosIndex;
+#define SMBIOS_INDEX_FIELDS 0
+#define SMBIOS_INDEX_TABLES 256
+
+// Read all smbios entries from fw_cfg in a single pass and index
+// them, so later lookups don't have to rescan the fw_cfg stream.
+static int
+qemu_cfg_smbios_index(void)
 {
-    int i;
+    if (SmbiosIndex)
+        return 0;
+    if (!qemu_cfg_present)
+        return -1;
 
+    // Allocate list heads, followed by list tails used during loading.
+    int indexsize = 2 * 256 * sizeof(SmbiosIndex[0]);
+    struct smbios_cfg_entry **index = malloc_tmphigh(indexsize * 2);
+    if (!index) {
+        warn_noalloc();
+        return -1;
+    }
+    memset(index, 0, indexsize * 2);
+    struct smbios_cfg_entry **tails = &index[2 * 256];
+
+    int i;
     for (i = qemu_cfg_smbios_entries(); i > 0; i--) {
         struct smbios_field field;
-
         qemu_cfg_read((u8 *)&field, sizeof(struct smbios_header));
-        field.header.length -= sizeof(struct smbios_header);
-
-        if (field.header.type != SMBIOS_FIELD_ENTRY) {
-            qemu_cfg_skip(field.header.length);
+        int len = field.header.length - sizeof(struct smbios_header);
+
+        int pos, offset = 0;
+        if (field.header.type == SMBIOS_FIELD_ENTRY
+            && len >= sizeof(field) - sizeof(struct smbios_header)) {
+            qemu_cfg_read((u8 *)&field.type,
+                          sizeof(field) - sizeof(struct smbios_header));
+            len -= sizeof(field) - sizeof(struct smbios_header);
+            pos = SMBIOS_INDEX_FIELDS + field.type;
+            offset = field.offset;
+        } else if (field.header.type == SMBIOS_TABLE_ENTRY
+                   && len >= sizeof(struct smbios_structure_header)) {
+            pos = -1;
+        } else {
+            qemu_cfg_skip(len);
             continue;
         }
 
-        qemu_cfg_read((u8 *)&field.type,
-                      sizeof(field) - sizeof(struct smbios_header));
-        field.header.length -= sizeof(field) - sizeof(struct smbios_header);
-
-        if (field.type != type || field.offset != offset) {
-            qemu_cfg_skip(field.header.length);
+        struct smbios_cfg_entry *entry = malloc_tmphigh(sizeof(*entry) + len);
+        if (!entry) {
+            warn_noalloc();
+            qemu_cfg_skip(len);
             continue;
         }
+        qemu_cfg_read(entry->data, len);
+        entry->next = NULL;
+        entry->length = len;
+        entry->offset = offset;
+        if (pos < 0) {
+            struct smbios_structure_header *header = (void*)entry->data;
+            pos = SMBIOS_INDEX_TABLES + header->type;
+        }
 
-        qemu_cfg_read(addr, field.header.length);
-        return (size_t)field.header.length;
+        // Append to the list for this type.
+        if (tails[pos])
+            tails[pos]->next = entry;
+        else
+            index[pos] = entry;
+        tails[pos] = entry;
+    }
+
+    SmbiosIndex = index;
+    return 0;
+}
+
+size_t qemu_cfg_smbios_load_field(int type, size_t offset, void *addr)
+{
+    if (qemu_cfg_smbios_index())
+        return 0;
+
+    struct smbios_cfg_entry *entry;
+    for (entry = SmbiosIndex[SMBIOS_INDEX_FIELDS + (type & 0xff)]; entry
+             ; entry = entry->next) {
+        if (entry->offset != offset)
+            continue;
+        memcpy(addr, entry->data, entry->length);
+        return entry->length;
     }
     return 0;
 }
@@ -203,7 +272,6 @@ int qemu_cfg_smbios_load_external(int type, char **p, unsigned *nr_structs,
 {
     static u64 used_bitmap[4] = { 0 };
     char *start = *p;
-    int i;
 
     /* Check if we've already reported these tables */
     if (used_bitmap[(type >> 6) & 0x3] & (1ULL << (type & 0x3f)))
@@ -213,48 +281,27 @@ int qemu_cfg_smbios_load_external(int type, char **p, unsigned *nr_structs,
     if (type == 127)
         return 0;
 
-    for (i = qemu_cfg_smbios_entries(); i > 0; i--) {
-        struct smbios_table table;
-        struct smbios_structure_header *header = (void *)*p;
-        int string;
-
-        qemu_cfg_read((u8 *)&table, sizeof(struct smbios_header));
-        table.header.length -= sizeof(struct smbios_header);
+    if (qemu_cfg_smbios_index())
+        return 0;
 
-        if (table.header.type != SMBIOS_TABLE_ENTRY) {
-            qemu_cfg_skip(table.header.length);
-            continue;
-        }
+    struct smbios_cfg_entry *entry;
+    for (entry = SmbiosIndex[SMBIOS_INDEX_TABLES + (type & 0xff)]; entry
+             ; entry = entry->next) {
+        struct smbios_structure_header *header = (void *)*p;
 
-        if (end - *p < sizeof(struct smbios_structure_header)) {
+        if (end - *p < entry->length) {
             warn_noalloc();
-            break;
-        }
-
-        qemu_cfg_read((u8 *)*p, sizeof(struct smbios_structure_header));
-        table.header.length -= sizeof(struct smbios_structure_header);
-
-        if (header->type != type) {
-            qemu_cfg_skip(table.header.length);
             continue;
         }
-
-        *p += sizeof(struct smbios_structure_header);
+        memcpy(*p, entry->data, entry->length);
+        *p += entry->length;
 
         /* Entries end with a double NULL char, if there's a string at
          * the end (length is greater than formatted length), the string
          * terminator provides the first NULL. */
-        string = header->length < table.header.length +
-                 sizeof(struct smbios_structure_header);
+        int string = header->length < entry->length;
 
-        /* Read the rest and terminate the entry */
-        if (end - *p < table.header.length) {
-            warn_noalloc();
-            *p -= sizeof(struct smbios_structure_header);
-            continue;
-        }
-        qemu_cfg_read((u8 *)*p, table.header.length);
-        *p += table.header.length;
+        /* Terminate the entry */
         *((u8*)*p) = 0;
         (*p)++;
         if (!string) {
@@ -383,6 +430,17 @@ int qemu_cfg_read_file(u32 select, void *dst, u32 maxlen)
     return len;
 }
 
+int qemu_cfg_read_file_head(u32 select, void *dst, u32 len)
+{
+    int size = qemu_cfg_size_file(select);
+    if (size < 0)
+        return -1;
+    if (len > size)
+        len = size;
+    qemu_cfg_read_entry(dst, select, len);
+    return len;
+}
+
 // Helper function to find, malloc_tmphigh, and copy a romfile.  This
 // function adds a trailing zero to the malloc'd copy.
 void *
@@ -74,6 +74,7 @@ u32 qemu_cfg_find_file(const char *name);
 int qemu_cfg_size_file(u32 select);
 const char* qemu_cfg_name_file(u32 select);
 int qemu_cfg_read_file(u32 select, void *dst, u32 maxlen);
+int qemu_cfg_read_file_head(u32 select, void *dst, u32 len);
 
 // Wrappers that select cbfs or qemu_cfg file interface.
 static inline u32 romfile_findprefix(const char *prefix, u32 previd) {
@@ -96,6 +97,12 @@ static inline int romfile_copy(u32 fileid, void *dst, u32 maxlen) {
         return cbfs_copyfile((void*)fileid, dst, maxlen);
     return qemu_cfg_read_file(fileid, dst, maxlen);
 }
+// Copy only the first 'len' bytes of a file (or the whole file if smaller).
+static inline int romfile_copyhead(u32 fileid, void *dst, u32 len) {
+    if (CONFIG_COREBOOT)
+        return cbfs_copyhead((void*)fileid, dst, len);
+    return qemu_cfg_read_file_head(fileid, dst, len);
+}
 static inline const char* romfile_name(u32 fileid) {
     if (CONFIG_COREBOOT)
         return cbfs_filename((void*)fileid);
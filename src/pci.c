@@ -12,39 +12,75 @@
 #include "farptr.h" // MAKE_FLATPTR
 #include "pci_regs.h" // PCI_VENDOR_ID
 #include "pci_ids.h" // PCI_CLASS_DISPLAY_VGA
+#include "memmap.h" // add_e820
+
+// Flat address of the memory mapped (ECAM) config space - zero when
+// only the 0xcf8/0xcfc ports are available.
+u32 PCIMmcfgBase;
+u8 PCIMmcfgEndBus;
+
+// Memory mapped config access is only available in 32bit flat mode.
+static inline int pci_use_mmcfg(u16 bdf)
+{
+    return (!MODESEGMENT && PCIMmcfgBase
+            && pci_bdf_to_bus(bdf) <= PCIMmcfgEndBus);
+}
+
+static inline void *pci_mmcfg_addr(u16 bdf, u32 addr)
+{
+    return (void*)(PCIMmcfgBase + (bdf << 12) + (addr & 0xfff));
+}
 
 void pci_config_writel(u16 bdf, u32 addr, u32 val)
 {
+    if (pci_use_mmcfg(bdf)) {
+        writel(pci_mmcfg_addr(bdf, addr & ~3), val);
+        return;
+    }
     outl(0x80000000 | (bdf << 8) | (addr & 0xfc), PORT_PCI_CMD);
     outl(val, PORT_PCI_DATA);
 }
 
 void pci_config_writew(u16 bdf, u32 addr, u16 val)
 {
+    if (pci_use_mmcfg(bdf)) {
+        writew(pci_mmcfg_addr(bdf, addr & ~1), val);
+        return;
+    }
     outl(0x80000000 | (bdf << 8) | (addr & 0xfc), PORT_PCI_CMD);
     outw(val, PORT_PCI_DATA + (addr & 2));
 }
 
 void pci_config_writeb(u16 bdf, u32 addr, u8 val)
 {
+    if (pci_use_mmcfg(bdf)) {
+        writeb(pci_mmcfg_addr(bdf, addr), val);
+        return;
+    }
     outl(0x80000000 | (bdf << 8) | (addr & 0xfc), PORT_PCI_CMD);
     outb(val, PORT_PCI_DATA + (addr & 3));
 }
 
 u32 pci_config_readl(u16 bdf, u32 addr)
 {
+    if (pci_use_mmcfg(bdf))
+        return readl(pci_mmcfg_addr(bdf, addr & ~3));
     outl(0x80000000 | (bdf << 8) | (addr & 0xfc), PORT_PCI_CMD);
     return inl(PORT_PCI_DATA);
 }
 
 u16 pci_config_readw(u16 bdf, u32 addr)
 {
+    if (pci_use_mmcfg(bdf))
+        return readw(pci_mmcfg_addr(bdf, addr & ~1));
     outl(0x80000000 | (bdf << 8) | (addr & 0xfc), PORT_PCI_CMD);
     return inw(PORT_PCI_DATA + (addr & 2));
 }
 
 u8 pci_config_readb(u16 bdf, u32 addr)
 {
+    if (pci_use_mmcfg(bdf))
+        return readb(pci_mmcfg_addr(bdf, addr));
     outl(0x80000000 | (bdf << 8) | (addr & 0xfc), PORT_PCI_CMD);
     return inb(PORT_PCI_DATA + (addr & 3));
 }
@@ -57,6 +93,90 @@ pci_config_maskw(u16 bdf, u32 addr, u16 off, u16 on)
     pci_config_writew(bdf, addr, val);
 }
 
+// Find a capability in the standard capability list (returns its
+// config space offset or zero).
+u8
+pci_find_capability(u16 bdf, u8 cap_id)
+{
+    if (!(pci_config_readw(bdf, PCI_STATUS) & PCI_STATUS_CAP_LIST))
+        return 0;
+    u8 cap = pci_config_readb(bdf, PCI_CAPABILITY_LIST);
+    int ttl = 48;
+    while (cap >= 0x40 && ttl--) {
+        cap &= ~3;
+        if (pci_config_readb(bdf, cap + PCI_CAP_LIST_ID) == cap_id)
+            return cap;
+        cap = pci_config_readb(bdf, cap + PCI_CAP_LIST_NEXT);
+    }
+    return 0;
+}
+
+// Find a pci express extended capability (returns its config space
+// offset or zero).  This requires memory mapped config access.
+u16
+pci_find_ext_capability(u16 bdf, u16 cap_id)
+{
+    if (!pci_use_mmcfg(bdf) || !pci_find_capability(bdf, PCI_CAP_ID_EXP))
+        return 0;
+    u16 cap = PCI_CFG_SPACE_SIZE;
+    int ttl = (PCI_CFG_SPACE_EXP_SIZE - PCI_CFG_SPACE_SIZE) / 8;
+    while (cap >= PCI_CFG_SPACE_SIZE && ttl--) {
+        u32 header = pci_config_readl(bdf, cap);
+        if (header == 0 || header == 0xffffffff)
+            return 0;
+        if (PCI_EXT_CAP_ID(header) == cap_id)
+            return cap;
+        cap = PCI_EXT_CAP_NEXT(header);
+    }
+    return 0;
+}
+
+// Q35 host bridge memory mapped config space register.
+#define Q35_HOST_BRIDGE_PCIEXBAR        0x60
+#define Q35_PCIEXBAR_ENABLE             0x01
+#define Q35_PCIEXBAR_LENGTH_MASK        0x06
+#define Q35_PCIEXBAR_LENGTH_64M         0x04
+#define Q35_PCIEXBAR_SIZE               (64 * 1024 * 1024)
+
+// Locate (or enable) memory mapped config access.
+void
+pci_mmcfg_setup(void)
+{
+    u32 base = romfile_loadint("etc/mcfg-base", 0);
+    u32 size = romfile_loadint("etc/mcfg-size", 0);
+    u16 bdf = pci_to_bdf(0, 0, 0);
+    u32 vendev = pci_config_readl(bdf, PCI_VENDOR_ID);
+    if (!base && vendev == ((PCI_DEVICE_ID_INTEL_Q35_MCH << 16)
+                            | PCI_VENDOR_ID_INTEL)) {
+        u32 bar = pci_config_readl(bdf, Q35_HOST_BRIDGE_PCIEXBAR);
+        u32 barhi = pci_config_readl(bdf, Q35_HOST_BRIDGE_PCIEXBAR + 4);
+        if (bar & Q35_PCIEXBAR_ENABLE) {
+            // Already enabled (by coreboot or on resume).
+            size = (256 * 1024 * 1024) >> ((bar & Q35_PCIEXBAR_LENGTH_MASK) >> 1);
+            base = bar & ~(size - 1);
+            if (barhi)
+                base = 0;
+        } else if (!CONFIG_COREBOOT) {
+            // Place a 64 bus window at the bottom of the pci hole.
+            base = BUILD_PCIMEM_START;
+            size = Q35_PCIEXBAR_SIZE;
+            pci_config_writel(bdf, Q35_HOST_BRIDGE_PCIEXBAR + 4, 0);
+            pci_config_writel(bdf, Q35_HOST_BRIDGE_PCIEXBAR
+                              , base | Q35_PCIEXBAR_LENGTH_64M
+                              | Q35_PCIEXBAR_ENABLE);
+        }
+    }
+    if (!base || size < 1024 * 1024)
+        return;
+    if (size > 256 * 1024 * 1024)
+        size = 256 * 1024 * 1024;
+
+    PCIMmcfgBase = base;
+    PCIMmcfgEndBus = (size >> 20) - 1;
+    add_e820(base, size, E820_RESERVED);
+    dprintf(1, "PCI: mmconfig at %08x (buses 0-%d)\n", base, PCIMmcfgEndBus);
+}
+
 // Helper function for foreachbdf() macro - return next device
 int
 pci_next(int bdf, int bus)
@@ -87,6 +207,41 @@ pci_next(int bdf, int bus)
 
 struct pci_device *PCIDevices;
 int MaxPCIBus VAR16VISIBLE;
+struct pci_bios_table *PCIBiosTable VAR16VISIBLE;
+
+// Build the pci bios lookup table from the PCIDevices list.
+static void
+pci_bios_table_setup(int count)
+{
+    struct pci_bios_table *t = malloc_fseg(
+        sizeof(*t) + count * sizeof(t->entries[0]));
+    if (!t) {
+        warn_noalloc();
+        return;
+    }
+    t->count = count;
+    memset(t->devhash, 0xff, sizeof(t->devhash));
+    memset(t->classhash, 0xff, sizeof(t->classhash));
+    struct pci_device *pci;
+    int i = 0;
+    foreachpci(pci) {
+        struct pci_bios_entry *e = &t->entries[i++];
+        e->vendev = (pci->device << 16) | pci->vendor;
+        e->classprog = pci_classprog(pci);
+        e->bdf = pci->bdf;
+    }
+    // Link the hash chains back to front so they end up in bdf order.
+    while (i--) {
+        struct pci_bios_entry *e = &t->entries[i];
+        u16 *head = &t->devhash[PCI_TABLE_HASH(e->vendev)];
+        e->nextdev = *head;
+        *head = i;
+        head = &t->classhash[PCI_TABLE_HASH(e->classprog)];
+        e->nextclass = *head;
+        *head = i;
+    }
+    PCIBiosTable = t;
+}
 
 // Find all PCI devices and populate PCIDevices linked list.
 void
@@ -155,6 +310,8 @@ pci_probe(void)
         }
     }
     dprintf(1, "Found %d PCI devices (max PCI bus is %02x)\n", count, MaxPCIBus);
+
+    pci_bios_table_setup(count);
 }
 
 // Search for a device with the specified vendor and device ids.
@@ -6,6 +6,9 @@
 #define PCI_ROM_SLOT 6
 #define PCI_NUM_REGIONS 7
 
+#define PCI_CFG_SPACE_SIZE 256
+#define PCI_CFG_SPACE_EXP_SIZE 4096
+
 static inline u8 pci_bdf_to_bus(u16 bdf) {
     return bdf >> 8;
 }
@@ -35,6 +38,11 @@ u32 pci_config_readl(u16 bdf, u32 addr);
 u16 pci_config_readw(u16 bdf, u32 addr);
 u8 pci_config_readb(u16 bdf, u32 addr);
 void pci_config_maskw(u16 bdf, u32 addr, u16 off, u16 on);
+u8 pci_find_capability(u16 bdf, u8 cap_id);
+u16 pci_find_ext_capability(u16 bdf, u16 cap_id);
+void pci_mmcfg_setup(void);
+extern u32 PCIMmcfgBase;
+extern u8 PCIMmcfgEndBus;
 
 struct pci_device *pci_find_device(u16 vendid, u16 devid);
 struct pci_device *pci_find_class(u16 classid);
@@ -53,7 +61,7 @@ struct pci_device {
     u8 secondary_bus;
     struct {
         u32 addr;
-        u32 size;
+        u64 size;
         int is64;
     } bars[PCI_NUM_REGIONS];
 
@@ -62,6 +70,7 @@ struct pci_device {
 };
 extern struct pci_device *PCIDevices;
 extern int MaxPCIBus;
+extern u64 PCIMem64Start, PCIMem64End;
 void pci_probe(void);
 static inline u32 pci_classprog(struct pci_device *pci) {
     return (pci->class << 8) | pci->prog_if;
@@ -70,6 +79,25 @@ static inline u32 pci_classprog(struct pci_device *pci) {
 #define foreachpci(PCI)                         \
     for (PCI=PCIDevices; PCI; PCI=PCI->next)
 
+// Copy of the device list (in the f-segment) used by the pci bios
+// find device/class calls.  Each hash chain is kept in bdf order.
+#define PCI_TABLE_HASHSIZE 32
+#define PCI_TABLE_END 0xffff
+#define PCI_TABLE_HASH(v) (((v) ^ ((v) >> 16) ^ ((v) >> 8))     \
+                           & (PCI_TABLE_HASHSIZE-1))
+struct pci_bios_table {
+    u16 count;
+    u16 devhash[PCI_TABLE_HASHSIZE];
+    u16 classhash[PCI_TABLE_HASHSIZE];
+    struct pci_bios_entry {
+        u32 vendev;
+        u32 classprog;
+        u16 bdf;
+        u16 nextdev, nextclass;
+    } entries[0];
+};
+extern struct pci_bios_table *PCIBiosTable;
+
 int pci_next(int bdf, int bus);
 #define foreachbdf(BDF, BUS)                                    \
     for (BDF=pci_next(pci_bus_devfn_to_bdf((BUS), 0)-1, (BUS))  \
@@ -33,12 +33,47 @@ handle_1ab101(struct bregs *regs)
     set_code_success(regs);
 }
 
+// Look up the count'th device with the given vendor/device (or class)
+// id in the PCIBiosTable.
+static int
+pci_table_find(struct pci_bios_table *table, u32 id, int count, int byclass)
+{
+    int hash = PCI_TABLE_HASH(id);
+    u16 i = (byclass ? GET_GLOBALFLAT(table->classhash[hash])
+             : GET_GLOBALFLAT(table->devhash[hash]));
+    while (i != PCI_TABLE_END) {
+        struct pci_bios_entry *e = &table->entries[i];
+        if (byclass) {
+            if (GET_GLOBALFLAT(e->classprog) == id && !count--)
+                return GET_GLOBALFLAT(e->bdf);
+            i = GET_GLOBALFLAT(e->nextclass);
+        } else {
+            if (GET_GLOBALFLAT(e->vendev) == id && !count--)
+                return GET_GLOBALFLAT(e->bdf);
+            i = GET_GLOBALFLAT(e->nextdev);
+        }
+    }
+    return -1;
+}
+
 // find pci device
 static void
 handle_1ab102(struct bregs *regs)
 {
     u32 id = (regs->cx << 16) | regs->dx;
     int count = regs->si;
+    struct pci_bios_table *table = GET_GLOBAL(PCIBiosTable);
+    if (table) {
+        int bdf = pci_table_find(table, id, count, 0);
+        if (bdf < 0) {
+            set_code_invalid(regs, RET_DEVICE_NOT_FOUND);
+            return;
+        }
+        regs->bx = bdf;
+        set_code_success(regs);
+        return;
+    }
+
     int bus = -1;
     while (bus < GET_GLOBAL(MaxPCIBus)) {
         bus++;
@@ -63,6 +98,18 @@ handle_1ab103(struct bregs *regs)
 {
     int count = regs->si;
     u32 classprog = regs->ecx;
+    struct pci_bios_table *table = GET_GLOBAL(PCIBiosTable);
+    if (table) {
+        int bdf = pci_table_find(table, classprog, count, 1);
+        if (bdf < 0) {
+            set_code_invalid(regs, RET_DEVICE_NOT_FOUND);
+            return;
+        }
+        regs->bx = bdf;
+        set_code_success(regs);
+        return;
+    }
+
     int bus = -1;
     while (bus < GET_GLOBAL(MaxPCIBus)) {
         bus++;
@@ -34,25 +34,36 @@ static const char *region_type_name[] = {
 static struct pci_bus {
     struct {
         /* pci region stats */
-        u32 count[32 - PCI_MEM_INDEX_SHIFT];
-        u32 sum, max;
+        u32 count[64 - PCI_MEM_INDEX_SHIFT];
+        u64 sum, max;
+        /* set if the region holds a bar that must stay below 4G */
+        int need32;
         /* seconday bus region sizes */
-        u32 size;
+        u64 size;
         /* pci region assignments */
-        u32 bases[32 - PCI_MEM_INDEX_SHIFT];
-        u32 base;
+        u64 bases[64 - PCI_MEM_INDEX_SHIFT];
+        u64 base;
     } r[PCI_REGION_TYPE_COUNT];
 } *busses;
 static int busses_count;
 
+// Window for 64bit prefetchable bars above 4G (zero if unused).
+u64 PCIMem64Start, PCIMem64End;
+
 static void pci_bios_init_device_in_bus(int bus);
 static void pci_bios_check_device_in_bus(int bus);
 static void pci_bios_init_bus_bases(struct pci_bus *bus);
 static void pci_bios_map_device_in_bus(int bus);
 
-static int pci_size_to_index(u32 size, enum pci_region_type type)
+static int pci_fls64(u64 val)
+{
+    u32 hi = val >> 32;
+    return hi ? __fls(hi) + 32 : __fls(val);
+}
+
+static int pci_size_to_index(u64 size, enum pci_region_type type)
 {
-    int index = __fls(size);
+    int index = pci_fls64(size);
     int shift = (type == PCI_REGION_TYPE_IO) ?
         PCI_IO_INDEX_SHIFT : PCI_MEM_INDEX_SHIFT;
 
@@ -62,12 +73,12 @@ static int pci_size_to_index(u32 size, enum pci_region_type type)
     return index;
 }
 
-static u32 pci_index_to_size(int index, enum pci_region_type type)
+static u64 pci_index_to_size(int index, enum pci_region_type type)
 {
     int shift = (type == PCI_REGION_TYPE_IO) ?
         PCI_IO_INDEX_SHIFT : PCI_MEM_INDEX_SHIFT;
 
-    return 0x1 << (index + shift);
+    return (u64)1 << (index + shift);
 }
 
 static enum pci_region_type pci_addr_to_type(u32 addr)
@@ -79,10 +90,10 @@ static enum pci_region_type pci_addr_to_type(u32 addr)
     return PCI_REGION_TYPE_MEM;
 }
 
-static u32 pci_size_roundup(u32 size)
+static u64 pci_size_roundup(u64 size)
 {
-    int index = __fls(size-1)+1;
-    return 0x1 << index;
+    int index = pci_fls64(size-1)+1;
+    return (u64)1 << index;
 }
 
 /* host irqs corresponding to PCI irqs A-D */
@@ -251,6 +262,14 @@ static void pci_bios_init_device(struct pci_device *pci)
         pci_config_writeb(bdf, PCI_INTERRUPT_LINE, pic_irq);
     }
 
+    u16 sriov = pci_find_ext_capability(bdf, PCI_EXT_CAP_ID_SRIOV);
+    if (sriov)
+        dprintf(1, "  SR-IOV: %d of %d VFs%s\n"
+                , pci_config_readw(bdf, sriov + PCI_SRIOV_INITIAL_VF)
+                , pci_config_readw(bdf, sriov + PCI_SRIOV_TOTAL_VF)
+                , pci_find_ext_capability(bdf, PCI_EXT_CAP_ID_ARI)
+                  ? " (ARI)" : "");
+
     pci_init_device(pci_device_tbl, pci, NULL);
 }
 
@@ -337,7 +356,7 @@ pci_bios_init_bus(void)
 }
 
 static void pci_bios_bus_get_bar(struct pci_bus *bus, int bdf, int bar,
-                                 u32 *val, u32 *size)
+                                 u32 *val, u64 *size, int *is64)
 {
     u32 ofs = pci_bar(bdf, bar);
     u32 old = pci_config_readl(bdf, ofs);
@@ -355,10 +374,24 @@ static void pci_bios_bus_get_bar(struct pci_bus *bus, int bdf, int bar,
     }
     *val = pci_config_readl(bdf, ofs);
     pci_config_writel(bdf, ofs, old);
-    *size = (~(*val & mask)) + 1;
+
+    *is64 = (bar != PCI_ROM_SLOT && !(*val & PCI_BASE_ADDRESS_SPACE_IO) &&
+             (*val & PCI_BASE_ADDRESS_MEM_TYPE_MASK) == PCI_BASE_ADDRESS_MEM_TYPE_64);
+    if (!*is64) {
+        *size = (u32)(~(*val & mask) + 1);
+        return;
+    }
+
+    // Size the upper dword of a 64bit bar.
+    u32 oldhi = pci_config_readl(bdf, ofs + 4);
+    pci_config_writel(bdf, ofs + 4, ~0);
+    u32 hi = pci_config_readl(bdf, ofs + 4);
+    pci_config_writel(bdf, ofs + 4, oldhi);
+    *size = ~(((u64)hi << 32) | (*val & mask)) + 1;
 }
 
-static void pci_bios_bus_reserve(struct pci_bus *bus, int type, u32 size)
+static void pci_bios_bus_reserve(struct pci_bus *bus, int type, u64 size,
+                                 int is64)
 {
     u32 index;
 
@@ -368,11 +401,14 @@ static void pci_bios_bus_reserve(struct pci_bus *bus, int type, u32 size)
     bus->r[type].sum += size;
     if (bus->r[type].max < size)
         bus->r[type].max = size;
+    if (!is64)
+        bus->r[type].need32 = 1;
 }
 
-static u32 pci_bios_bus_get_addr(struct pci_bus *bus, int type, u32 size)
+static u64 pci_bios_bus_get_addr(struct pci_bus *bus, int type, u64 size)
 {
-    u32 index, addr;
+    u32 index;
+    u64 addr;
 
     index = pci_size_to_index(size, type);
     addr = bus->r[type].bases[index];
@@ -402,27 +438,36 @@ static void pci_bios_check_device(struct pci_bus *bus, struct pci_device *dev)
             if (s->r[type].size < limit)
                 s->r[type].size = limit;
             s->r[type].size = pci_size_roundup(s->r[type].size);
-            pci_bios_bus_reserve(bus, type, s->r[type].size);
+            // Only the prefetchable window has upper 32bit registers.
+            int is64 = (type == PCI_REGION_TYPE_PREFMEM
+                        && !s->r[type].need32
+                        && ((pci_config_readw(bdf, PCI_PREF_MEMORY_BASE)
+                             & PCI_PREF_RANGE_TYPE_MASK)
+                            == PCI_PREF_RANGE_TYPE_64));
+            pci_bios_bus_reserve(bus, type, s->r[type].size, is64);
         }
-        dprintf(1, "PCI: secondary bus %d sizes: io %x, mem %x, prefmem %x\n",
+        u64 prefsize = s->r[PCI_REGION_TYPE_PREFMEM].size;
+        dprintf(1, "PCI: secondary bus %d sizes: io %x, mem %x"
+                ", prefmem %08x%08x\n",
                 dev->secondary_bus,
-                s->r[PCI_REGION_TYPE_IO].size,
-                s->r[PCI_REGION_TYPE_MEM].size,
-                s->r[PCI_REGION_TYPE_PREFMEM].size);
+                (u32)s->r[PCI_REGION_TYPE_IO].size,
+                (u32)s->r[PCI_REGION_TYPE_MEM].size,
+                (u32)(prefsize >> 32), (u32)prefsize);
         return;
     }
 
     for (i = 0; i < PCI_NUM_REGIONS; i++) {
-        u32 val, size;
-        pci_bios_bus_get_bar(bus, bdf, i, &val, &size);
+        u32 val;
+        u64 size;
+        int is64;
+        pci_bios_bus_get_bar(bus, bdf, i, &val, &size, &is64);
         if (val == 0) {
             continue;
         }
-        pci_bios_bus_reserve(bus, pci_addr_to_type(val), size);
+        pci_bios_bus_reserve(bus, pci_addr_to_type(val), size, is64);
         dev->bars[i].addr = val;
         dev->bars[i].size = size;
-        dev->bars[i].is64 = (!(val & PCI_BASE_ADDRESS_SPACE_IO) &&
-            (val & PCI_BASE_ADDRESS_MEM_TYPE_MASK) == PCI_BASE_ADDRESS_MEM_TYPE_64);
+        dev->bars[i].is64 = is64;
 
         if (dev->bars[i].is64) {
             i++;
@@ -441,6 +486,7 @@ static void pci_bios_map_device(struct pci_bus *bus, struct pci_device *dev)
         }
         struct pci_bus *s = busses + dev->secondary_bus;
         u32 base, limit;
+        u64 base64, limit64;
 
         for (type = 0; type < PCI_REGION_TYPE_COUNT; type++) {
             s->r[type].base = pci_bios_bus_get_addr(bus, type, s->r[type].size);
@@ -460,31 +506,33 @@ static void pci_bios_map_device(struct pci_bus *bus, struct pci_device *dev)
         pci_config_writew(bdf, PCI_MEMORY_BASE, base >> PCI_MEMORY_SHIFT);
         pci_config_writew(bdf, PCI_MEMORY_LIMIT, limit >> PCI_MEMORY_SHIFT);
 
-        base = s->r[PCI_REGION_TYPE_PREFMEM].base;
-        limit = base + s->r[PCI_REGION_TYPE_PREFMEM].size - 1;
-        pci_config_writew(bdf, PCI_PREF_MEMORY_BASE, base >> PCI_PREF_MEMORY_SHIFT);
-        pci_config_writew(bdf, PCI_PREF_MEMORY_LIMIT, limit >> PCI_PREF_MEMORY_SHIFT);
-        pci_config_writel(bdf, PCI_PREF_BASE_UPPER32, 0);
-        pci_config_writel(bdf, PCI_PREF_LIMIT_UPPER32, 0);
+        base64 = s->r[PCI_REGION_TYPE_PREFMEM].base;
+        limit64 = base64 + s->r[PCI_REGION_TYPE_PREFMEM].size - 1;
+        pci_config_writew(bdf, PCI_PREF_MEMORY_BASE, (u32)base64 >> PCI_PREF_MEMORY_SHIFT);
+        pci_config_writew(bdf, PCI_PREF_MEMORY_LIMIT, (u32)limit64 >> PCI_PREF_MEMORY_SHIFT);
+        pci_config_writel(bdf, PCI_PREF_BASE_UPPER32, base64 >> 32);
+        pci_config_writel(bdf, PCI_PREF_LIMIT_UPPER32, limit64 >> 32);
 
         pci_bios_map_device_in_bus(dev->secondary_bus);
         return;
     }
 
     for (i = 0; i < PCI_NUM_REGIONS; i++) {
-        u32 addr;
+        u64 addr;
         if (dev->bars[i].addr == 0) {
             continue;
         }
 
         addr = pci_bios_bus_get_addr(bus, pci_addr_to_type(dev->bars[i].addr),
                                      dev->bars[i].size);
-        dprintf(1, "  bar %d, addr %x, size %x [%s]\n",
-                i, addr, dev->bars[i].size,
+        dprintf(1, "  bar %d, addr %08x%08x, size %08x%08x [%s]\n",
+                i, (u32)(addr >> 32), (u32)addr,
+                (u32)(dev->bars[i].size >> 32), (u32)dev->bars[i].size,
                 dev->bars[i].addr & PCI_BASE_ADDRESS_SPACE_IO ? "io" : "mem");
         pci_set_io_region_addr(bdf, i, addr);
 
         if (dev->bars[i].is64) {
+            pci_config_writel(bdf, pci_bar(bdf, i) + 4, addr >> 32);
             i++;
         }
     }
@@ -516,65 +564,109 @@ static void pci_bios_map_device_in_bus(int bus)
 
 static void pci_bios_init_bus_bases(struct pci_bus *bus)
 {
-    u32 base, newbase, size;
+    u64 base, newbase, size;
     int type, i;
 
     for (type = 0; type < PCI_REGION_TYPE_COUNT; type++) {
-        dprintf(1, "  type %s max %x sum %x base %x\n", region_type_name[type],
-                bus->r[type].max, bus->r[type].sum, bus->r[type].base);
+        dprintf(1, "  type %s max %08x%08x sum %08x%08x base %08x%08x\n"
+                , region_type_name[type]
+                , (u32)(bus->r[type].max >> 32), (u32)bus->r[type].max
+                , (u32)(bus->r[type].sum >> 32), (u32)bus->r[type].sum
+                , (u32)(bus->r[type].base >> 32), (u32)bus->r[type].base);
         base = bus->r[type].base;
         for (i = ARRAY_SIZE(bus->r[type].count)-1; i >= 0; i--) {
             size = pci_index_to_size(i, type);
             if (!bus->r[type].count[i])
                 continue;
             newbase = base + size * bus->r[type].count[i];
-            dprintf(1, "    size %8x: %d bar(s), %8x -> %8x\n",
-                    size, bus->r[type].count[i], base, newbase - 1);
+            dprintf(1, "    size %08x%08x: %d bar(s), %08x%08x -> %08x%08x\n",
+                    (u32)(size >> 32), (u32)size, bus->r[type].count[i],
+                    (u32)(base >> 32), (u32)base,
+                    (u32)((newbase - 1) >> 32), (u32)(newbase - 1));
             bus->r[type].bases[i] = base;
             base = newbase;
         }
     }
 }
 
-#define ROOT_BASE(top, sum, align) ALIGN_DOWN((top)-(sum),(align))
+static u64 pci_root_base(u64 top, u64 sum, u64 align)
+{
+    if (!align)
+        return top;
+    return ALIGN_DOWN(top - sum, align);
+}
 
 static int pci_bios_init_root_regions(u32 start, u32 end)
 {
     struct pci_bus *bus = &busses[0];
+    int top = PCI_REGION_TYPE_PREFMEM, bottom = PCI_REGION_TYPE_MEM;
 
     bus->r[PCI_REGION_TYPE_IO].base = 0xc000;
 
     if (bus->r[PCI_REGION_TYPE_MEM].sum < bus->r[PCI_REGION_TYPE_PREFMEM].sum) {
-        bus->r[PCI_REGION_TYPE_MEM].base =
-            ROOT_BASE(end,
-                      bus->r[PCI_REGION_TYPE_MEM].sum,
-                      bus->r[PCI_REGION_TYPE_MEM].max);
-        bus->r[PCI_REGION_TYPE_PREFMEM].base =
-            ROOT_BASE(bus->r[PCI_REGION_TYPE_MEM].base,
-                      bus->r[PCI_REGION_TYPE_PREFMEM].sum,
-                      bus->r[PCI_REGION_TYPE_PREFMEM].max);
-        if (bus->r[PCI_REGION_TYPE_PREFMEM].base >= start) {
-            return 0;
-        }
-    } else {
-        bus->r[PCI_REGION_TYPE_PREFMEM].base =
-            ROOT_BASE(end,
-                      bus->r[PCI_REGION_TYPE_PREFMEM].sum,
-                      bus->r[PCI_REGION_TYPE_PREFMEM].max);
-        bus->r[PCI_REGION_TYPE_MEM].base =
-            ROOT_BASE(bus->r[PCI_REGION_TYPE_PREFMEM].base,
-                      bus->r[PCI_REGION_TYPE_MEM].sum,
-                      bus->r[PCI_REGION_TYPE_MEM].max);
-        if (bus->r[PCI_REGION_TYPE_MEM].base >= start) {
-            return 0;
-        }
+        top = PCI_REGION_TYPE_MEM;
+        bottom = PCI_REGION_TYPE_PREFMEM;
+    }
+    if (bus->r[top].sum + bus->r[bottom].sum > end - start)
+        return -1;
+    bus->r[top].base = pci_root_base(end, bus->r[top].sum, bus->r[top].max);
+    bus->r[bottom].base = pci_root_base(bus->r[top].base, bus->r[bottom].sum,
+                                        bus->r[bottom].max);
+    if (bus->r[bottom].base >= start) {
+        return 0;
     }
     return -1;
 }
 
+// Highest physical address supported by the cpu.
+static u64 pci_phys_limit(void)
+{
+    u32 eax, ebx, ecx, edx;
+    int bits = 36;
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000008) {
+        cpuid(0x80000008, &eax, &ebx, &ecx, &edx);
+        bits = eax & 0xff;
+    }
+    return (u64)1 << bits;
+}
+
+// Move the root bus prefetchable region to a window above 4G (after
+// the ram there) and fit the remaining regions in the 32bit hole.
+static int pci_bios_init_root_regions64(u32 start, u32 end)
+{
+    struct pci_bus *bus = &busses[0];
+    u64 sum = bus->r[PCI_REGION_TYPE_PREFMEM].sum;
+    u64 max = bus->r[PCI_REGION_TYPE_PREFMEM].max;
+
+    if (bus->r[PCI_REGION_TYPE_PREFMEM].need32 || !sum)
+        return -1;
+    u64 base = ALIGN(0x100000000ULL + RamSizeOver4G, max);
+    if (base + sum > pci_phys_limit())
+        return -1;
+
+    bus->r[PCI_REGION_TYPE_PREFMEM].sum = 0;
+    bus->r[PCI_REGION_TYPE_PREFMEM].max = 0;
+    int ret = pci_bios_init_root_regions(start, end);
+    bus->r[PCI_REGION_TYPE_PREFMEM].sum = sum;
+    bus->r[PCI_REGION_TYPE_PREFMEM].max = max;
+    if (ret)
+        return ret;
+
+    bus->r[PCI_REGION_TYPE_PREFMEM].base = base;
+    PCIMem64Start = base;
+    PCIMem64End = base + sum - 1;
+    dprintf(1, "PCI: 64bit prefmem window %08x%08x - %08x%08x\n"
+            , (u32)(PCIMem64Start >> 32), (u32)PCIMem64Start
+            , (u32)(PCIMem64End >> 32), (u32)PCIMem64End);
+    return 0;
+}
+
 void
 pci_setup(void)
 {
+    pci_mmcfg_setup();
+
     if (CONFIG_COREBOOT || usingXen()) {
         // PCI setup already done by coreboot or Xen - just do probe.
         pci_probe();
@@ -585,6 +677,9 @@ pci_setup(void)
 
     u32 start = BUILD_PCIMEM_START;
     u32 end   = BUILD_PCIMEM_END;
+    if (PCIMmcfgBase == start)
+        // Memory mapped config space is at the bottom of the pci hole.
+        start += (PCIMmcfgEndBus + 1) << 20;
 
     dprintf(1, "=== PCI bus & bridge init ===\n");
     pci_bios_init_bus();
@@ -596,7 +691,8 @@ pci_setup(void)
     busses = malloc_tmp(sizeof(*busses) * busses_count);
     memset(busses, 0, sizeof(*busses) * busses_count);
     pci_bios_check_device_in_bus(0 /* host bus */);
-    if (pci_bios_init_root_regions(start, end) != 0) {
+    if (pci_bios_init_root_regions(start, end) != 0
+        && pci_bios_init_root_regions64(start, end) != 0) {
         panic("PCI: out of address space\n");
     }
 
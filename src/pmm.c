@@ -21,18 +21,54 @@ struct allocdetail_s {
     struct allocinfo_s detailinfo;
     struct allocinfo_s datainfo;
     u32 handle;
+    struct zone_s *zone;
+    struct alloctag_s *tag;
+    struct allocdetail_s *datanext, *handlenext;
 };
 
 // The various memory zones.
 struct zone_s {
     struct allocinfo_s *info;
+    // Allocation statistics
+    u32 used, peak, count, fails;
 };
 
 struct zone_s ZoneLow, ZoneHigh, ZoneFSeg, ZoneTmpLow, ZoneTmpHigh;
 
+// Reserved high memory for the option rom cache (if enabled).
+void *RomCacheSpace;
+
 static struct zone_s *Zones[] = {
     &ZoneTmpLow, &ZoneLow, &ZoneFSeg, &ZoneTmpHigh, &ZoneHigh
 };
+static const char *ZoneNames[] = {
+    "TmpLow", "Low", "FSeg", "TmpHigh", "High"
+};
+
+// Allocation accounting by the source file making the allocation.
+struct alloctag_s {
+    const char *tag;
+    struct zone_s *zone;
+    u32 count, total, used, peak;
+};
+#define MAX_ALLOC_TAGS 64
+static struct alloctag_s AllocTags[MAX_ALLOC_TAGS];
+static int AllocTagCount, EbdaMoves;
+
+static struct alloctag_s *
+findTag(const char *tag, struct zone_s *zone)
+{
+    int i;
+    for (i=0; i<AllocTagCount; i++)
+        if (AllocTags[i].tag == tag && AllocTags[i].zone == zone)
+            return &AllocTags[i];
+    if (AllocTagCount >= ARRAY_SIZE(AllocTags))
+        return NULL;
+    struct alloctag_s *t = &AllocTags[AllocTagCount++];
+    t->tag = tag;
+    t->zone = zone;
+    return t;
+}
 
 
 /****************************************************************
@@ -82,6 +118,8 @@ freeSpace(struct allocinfo_s *info)
     }
 }
 
+static struct allocdetail_s *allocDetail(void);
+
 // Add new memory to a zone
 static void
 addSpace(struct zone_s *zone, void *start, void *end)
@@ -106,18 +144,13 @@ addSpace(struct zone_s *zone, void *start, void *end)
         info->pprev = &tempdetail.datainfo.next;
 
     // Allocate final allocation info.
-    struct allocdetail_s *detail = allocSpace(
-        &ZoneTmpHigh, sizeof(*detail), MALLOC_MIN_ALIGN, NULL);
+    struct allocdetail_s *detail = allocDetail();
     if (!detail) {
-        detail = allocSpace(&ZoneTmpLow, sizeof(*detail)
-                            , MALLOC_MIN_ALIGN, NULL);
-        if (!detail) {
-            *tempdetail.datainfo.pprev = tempdetail.datainfo.next;
-            if (tempdetail.datainfo.next)
-                tempdetail.datainfo.next->pprev = tempdetail.datainfo.pprev;
-            warn_noalloc();
-            return;
-        }
+        *tempdetail.datainfo.pprev = tempdetail.datainfo.next;
+        if (tempdetail.datainfo.next)
+            tempdetail.datainfo.next->pprev = tempdetail.datainfo.pprev;
+        warn_noalloc();
+        return;
     }
 
     // Replace temp alloc space with final alloc space
@@ -129,17 +162,50 @@ addSpace(struct zone_s *zone, void *start, void *end)
         tempdetail.datainfo.next->pprev = &detail->datainfo.next;
 }
 
-// Search all zones for an allocation obtained from allocSpace()
-static struct allocinfo_s *
-findAlloc(void *data)
+// Hash index of pmm_malloc allocations (by data address and handle).
+#define ALLOC_HASH_BITS 7
+static struct allocdetail_s *DataHash[1 << ALLOC_HASH_BITS];
+static struct allocdetail_s *HandleHash[1 << ALLOC_HASH_BITS];
+
+static inline u32
+allocHash(u32 val)
 {
-    int i;
-    for (i=0; i<ARRAY_SIZE(Zones); i++) {
-        struct zone_s *zone = Zones[i];
-        struct allocinfo_s *info;
-        for (info = zone->info; info; info = info->next)
-            if (info->data == data)
-                return info;
+    return (val * 0x9E3779B1) >> (32 - ALLOC_HASH_BITS);
+}
+
+static void
+addAllocHash(struct allocdetail_s *detail)
+{
+    u32 h = allocHash((u32)detail->datainfo.data);
+    detail->datanext = DataHash[h];
+    DataHash[h] = detail;
+    detail->handlenext = NULL;
+    if (detail->handle == PMM_DEFAULT_HANDLE)
+        return;
+    h = allocHash(detail->handle);
+    detail->handlenext = HandleHash[h];
+    HandleHash[h] = detail;
+}
+
+// Find (and optionally remove) the tracked allocation for 'data'.
+static struct allocdetail_s *
+findAllocHash(void *data, int remove)
+{
+    struct allocdetail_s **pprev = &DataHash[allocHash((u32)data)], *detail;
+    for (detail = *pprev; detail; pprev = &detail->datanext
+             , detail = detail->datanext) {
+        if (detail->datainfo.data != data)
+            continue;
+        if (!remove)
+            return detail;
+        *pprev = detail->datanext;
+        if (detail->handle == PMM_DEFAULT_HANDLE)
+            return detail;
+        pprev = &HandleHash[allocHash(detail->handle)];
+        while (*pprev != detail)
+            pprev = &(*pprev)->handlenext;
+        *pprev = detail->handlenext;
+        return detail;
     }
     return NULL;
 }
@@ -171,7 +237,7 @@ malloc_setup(void)
     dprintf(3, "malloc setup\n");
 
     // Populate temp high ram
-    u32 highram = 0;
+    u32 highram = 0, romcache = 0;
     int i;
     for (i=e820_count-1; i>=0; i--) {
         struct e820entry *en = &e820_list[i];
@@ -187,10 +253,18 @@ malloc_setup(void)
                 highram = newe;
                 e = newe;
             }
+            newe = ALIGN_DOWN(e - CONFIG_MAX_ROMCACHE, MALLOC_MIN_ALIGN);
+            if (CONFIG_OPTIONROM_CACHE && highram && newe <= e && newe >= s) {
+                romcache = newe;
+                e = newe;
+            }
         }
         addSpace(&ZoneTmpHigh, (void*)s, (void*)e);
     }
 
+    // The e820 map may be using temporary low memory - move it out.
+    memmap_malloc_setup();
+
     // Populate other regions
     addSpace(&ZoneTmpLow, (void*)BUILD_STACK_ADDR, (void*)BUILD_EBDA_MINIMUM);
     addSpace(&ZoneFSeg, BiosTableSpace, &BiosTableSpace[CONFIG_MAX_BIOSTABLE]);
@@ -200,6 +274,22 @@ malloc_setup(void)
                  , (void*)highram + CONFIG_MAX_HIGHTABLE);
         add_e820(highram, CONFIG_MAX_HIGHTABLE, E820_RESERVED);
     }
+    if (romcache) {
+        // Space kept across reboots for initialized option roms.
+        RomCacheSpace = (void*)romcache;
+        add_e820(romcache, CONFIG_MAX_ROMCACHE, E820_RESERVED);
+    }
+}
+
+// Return the new location of a pointer into the pre-relocation init
+// code and data.
+static void *
+relocPtr(const void *p)
+{
+    extern u8 code32init_start[], code32init_end[];
+    if (p < (void*)code32init_start || p >= (void*)code32init_end)
+        return (void*)p;
+    return (void*)p + InitRelocDelta;
 }
 
 // Update pointers after code relocation.
@@ -217,6 +307,21 @@ malloc_fixupreloc(void)
         zone->info->pprev = &zone->info;
     }
 
+    // Allocations made before relocation recorded pointers to the old
+    // zones, tags, and tag names - move them to the relocated copies.
+    for (i=0; i<AllocTagCount; i++) {
+        struct alloctag_s *t = &AllocTags[i];
+        t->tag = relocPtr(t->tag);
+        t->zone = relocPtr(t->zone);
+    }
+    for (i=0; i<ARRAY_SIZE(DataHash); i++) {
+        struct allocdetail_s *detail;
+        for (detail = DataHash[i]; detail; detail = detail->datanext) {
+            detail->zone = relocPtr(detail->zone);
+            detail->tag = relocPtr(detail->tag);
+        }
+    }
+
     // Add space free'd during relocation in f-segment to ZoneFSeg
     extern u8 code32init_end[];
     if ((u32)code32init_end > BUILD_BIOS_ADDR) {
@@ -235,6 +340,33 @@ malloc_finalize(void)
     u32 endlow = GET_BDA(mem_size_kb)*1024;
     add_e820(endlow, BUILD_LOWRAM_END-endlow, E820_RESERVED);
 
+    // Report allocation statistics.
+    int i, j;
+    for (i=0; i<ARRAY_SIZE(Zones); i++) {
+        struct zone_s *zone = Zones[i];
+        dprintf(3, "Zone%s: %d allocations, %d bytes in use, %d peak"
+                ", %d failures\n", ZoneNames[i]
+                , zone->count, zone->used, zone->peak, zone->fails);
+        for (j=0; j<AllocTagCount; j++) {
+            struct alloctag_s *t = &AllocTags[j];
+            if (t->zone != zone)
+                continue;
+            const char *name = t->tag, *p;
+            for (p = name; *p; p++)
+                if (*p == '/')
+                    name = p + 1;
+            dprintf(3, "  %s: %d allocations, %d bytes (%d in use, %d peak)\n"
+                    , name
+                    , t->count, t->total, t->used, t->peak);
+        }
+    }
+    if (AllocTagCount >= ARRAY_SIZE(AllocTags))
+        dprintf(3, "  (allocation tag table full - report incomplete)\n");
+    dprintf(1, "ZoneLow peak use %d bytes (%d ebda relocations)\n"
+            , ZoneLow.peak, EbdaMoves);
+    dprintf(1, "ZoneHigh peak use %d of %d bytes (CONFIG_MAX_HIGHTABLE)\n"
+            , ZoneHigh.peak, CONFIG_MAX_HIGHTABLE);
+
     // Give back unused high ram.
     struct allocinfo_s *info = findLast(&ZoneHigh);
     if (info) {
@@ -245,6 +377,131 @@ malloc_finalize(void)
 }
 
 
+/****************************************************************
+ * RAM scrubbing
+ ****************************************************************/
+
+// The free space of the high memory zones is split into chunks which
+// all cpus claim (with an atomic increment) and zero in parallel.
+#define SCRUB_CHUNK (1024*1024)
+#define SCRUB_MAX_RANGES 64
+
+struct scrub_range_s {
+    u32 start, end, firstchunk;
+};
+static struct scrub_range_s *ScrubRanges;
+static u32 ScrubChunks, ScrubNextChunk, ScrubCpus, ScrubBytes;
+static u32 ScrubSkipLow, ScrubSkipHigh, ScrubDone;
+static u64 ScrubStart;
+
+// Per-cpu scrubbing work (run via smp_queue_work).
+static void
+scrub_cpu(u32 cpu)
+{
+    struct scrub_range_s *r = ScrubRanges;
+    for (;;) {
+        u32 chunk = 1;
+        asm volatile("lock xaddl %0, %1"
+                     : "+r"(chunk), "+m"(ScrubNextChunk) : : "memory");
+        if (chunk >= ScrubChunks)
+            break;
+        while (chunk >= r[1].firstchunk)
+            r++;
+        u32 start = r->start + (chunk - r->firstchunk) * SCRUB_CHUNK;
+        u32 end = start + SCRUB_CHUNK;
+        if (end > r->end || end < start)
+            end = r->end;
+        // memset uses non-temporal stores for large blocks.
+        memset((void*)start, 0, end - start);
+    }
+    asm volatile("lock incl %0" : "+m"(ScrubCpus) : : "memory");
+}
+
+// Add the free space of a zone to the list of ranges to scrub.
+static int
+scrub_add_zone(struct zone_s *zone, int count)
+{
+    struct allocinfo_s *info;
+    for (info = zone->info; info; info = info->next) {
+        u32 start = (u32)info->dataend, end = (u32)info->allocend;
+        if (end <= start)
+            continue;
+        if (count >= SCRUB_MAX_RANGES) {
+            warn_noalloc();
+            break;
+        }
+        struct scrub_range_s *r = &ScrubRanges[count++];
+        r->start = start;
+        r->end = end;
+        r->firstchunk = ScrubChunks;
+        ScrubChunks += DIV_ROUND_UP(end - start, SCRUB_CHUNK);
+        ScrubBytes += end - start;
+    }
+    return count;
+}
+
+// Queue the zeroing of all unused ram (called from smp_probe).
+void
+scrub_setup(void)
+{
+    ASSERT32FLAT();
+    if (!CONFIG_SCRUB_RAM)
+        return;
+    ScrubRanges = malloc_tmphigh(
+        sizeof(ScrubRanges[0]) * (SCRUB_MAX_RANGES + 1));
+    if (!ScrubRanges) {
+        warn_noalloc();
+        return;
+    }
+    int count = scrub_add_zone(&ZoneTmpHigh, 0);
+    count = scrub_add_zone(&ZoneHigh, count);
+    ScrubRanges[count].firstchunk = ScrubChunks;
+
+    // Note the ram that isn't covered - ram in use at this point, and
+    // ram above 4GB (which can't be reached without paging).
+    u64 ramlow = 0;
+    int i;
+    for (i=0; i<e820_count; i++) {
+        struct e820entry *en = &e820_list[i];
+        if (en->type != E820_RAM)
+            continue;
+        u64 start = en->start, end = en->start + en->size;
+        if (end > 0x100000000ull) {
+            u64 hstart = start > 0x100000000ull ? start : 0x100000000ull;
+            ScrubSkipHigh += (end - hstart) >> 20;
+            end = 0x100000000ull;
+        }
+        if (start < end)
+            ramlow += end - start;
+    }
+    ScrubSkipLow = ramlow > ScrubBytes ? ramlow - ScrubBytes : 0;
+
+    dprintf(3, "Scrubbing %d ranges (%u bytes)\n", count, ScrubBytes);
+    ScrubStart = rdtscll();
+    smp_queue_work(scrub_cpu);
+}
+
+// Report on the completed scrubbing.
+void
+scrub_finish(void)
+{
+    ASSERT32FLAT();
+    if (!CONFIG_SCRUB_RAM || !ScrubRanges)
+        return;
+    // Scale down the tsc delta to avoid a 64bit division.
+    u32 khz = GET_GLOBAL(cpu_khz) >> 8;
+    u32 ms = (u32)((rdtscll() - ScrubStart) >> 8) / (khz ?: 1);
+    dprintf(1, "Scrubbed %u MiB with %d cpu(s) in %u ms (%u MiB/s)\n"
+            , ScrubBytes >> 20, ScrubCpus, ms
+            , (ScrubBytes >> 20) * 1000 / (ms ?: 1));
+    dprintf(1, "Not scrubbed: %u KiB in use below 4GB, %u MiB above 4GB\n"
+            , ScrubSkipLow >> 10, ScrubSkipHigh);
+    ScrubDone = 1;
+    free(ScrubRanges);
+    ScrubRanges = NULL;
+}
+
+
 /****************************************************************
  * ebda movement
  ****************************************************************/
@@ -270,7 +527,7 @@ relocate_ebda(u32 newebda, u32 oldebda, u8 ebda_size)
 
 // Support expanding the ZoneLow dynamically.
 static void
-zonelow_expand(u32 size, u32 align)
+zonelow_expand(u32 size, u32 align, const char *tag)
 {
     struct allocinfo_s *info = findLast(&ZoneLow);
     if (!info)
@@ -298,6 +555,8 @@ zonelow_expand(u32 size, u32 align)
     int ret = relocate_ebda(newebda, ebda_pos, ebda_size);
     if (ret)
         return;
+    EbdaMoves++;
+    dprintf(3, "ZoneLow expanded for %d bytes from %s\n", size, tag);
 
     // Update zone
     if (ebda_end == bottom) {
@@ -310,7 +569,7 @@ zonelow_expand(u32 size, u32 align)
 // Check if can expand the given zone to fulfill an allocation
 static void *
 allocExpandSpace(struct zone_s *zone, u32 size, u32 align
-                 , struct allocinfo_s *fill)
+                 , struct allocinfo_s *fill, const char *tag)
 {
     void *data = allocSpace(zone, size, align, fill);
     if (data || zone != &ZoneLow)
@@ -323,37 +582,205 @@ allocExpandSpace(struct zone_s *zone, u32 size, u32 align
             return data;
     }
 
-    zonelow_expand(size, align);
+    zonelow_expand(size, align, tag);
     return allocSpace(zone, size, align, fill);
 }
 
 
+/****************************************************************
+ * size class (slab) allocations
+ ****************************************************************/
+
+// Small temporary allocations (and the pmm bookkeeping itself) are
+// carved out of page sized slabs so that allocating and freeing them
+// doesn't need to walk the zone lists.
+#define SLAB_SIZE 4096
+#define SLAB_HASH_BITS 6
+
+struct slab_s {
+    struct allocinfo_s info; // Zone reservation - must be first
+    struct slab_s *hashnext, *partialnext;
+    void *freelist;
+    u8 class; // Index into SizeClasses (which moves with the init code)
+    u32 inuse;
+};
+
+struct sizeclass_s {
+    u32 size;
+    struct slab_s *partial; // Slabs with at least one free object
+};
+static struct sizeclass_s SizeClasses[] = {
+    { 16 }, { 32 }, { 64 }, { 128 }, { 256 }, { 512 }
+};
+static struct slab_s *SlabHash[1 << SLAB_HASH_BITS];
+
+static inline struct sizeclass_s *
+slabClass(struct slab_s *slab)
+{
+    return &SizeClasses[slab->class];
+}
+
+static inline struct slab_s **
+slabBucket(void *page)
+{
+    return &SlabHash[((u32)page / SLAB_SIZE) & ((1 << SLAB_HASH_BITS) - 1)];
+}
+
+// Find the slab containing the given object (if any).
+static struct slab_s *
+slabFind(void *data)
+{
+    void *page = (void*)ALIGN_DOWN((u32)data, SLAB_SIZE);
+    struct slab_s *slab;
+    for (slab = *slabBucket(page); slab; slab = slab->hashnext)
+        if (slab == page)
+            return data != page ? slab : NULL;
+    return NULL;
+}
+
+// Allocate a new slab for a size class.
+static struct slab_s *
+slabGrow(int classidx)
+{
+    struct slab_s *slab = allocSpace(&ZoneTmpHigh, SLAB_SIZE, SLAB_SIZE, NULL);
+    if (!slab)
+        return NULL;
+    struct sizeclass_s *class = &SizeClasses[classidx];
+    slab->class = classidx;
+    slab->inuse = 0;
+    slab->freelist = NULL;
+    void *obj = (void*)slab + ALIGN(sizeof(*slab), class->size);
+    void *end = (void*)slab + SLAB_SIZE;
+    for (; obj + class->size <= end; obj += class->size) {
+        *(void**)obj = slab->freelist;
+        slab->freelist = obj;
+    }
+    struct slab_s **bucket = slabBucket(slab);
+    slab->hashnext = *bucket;
+    *bucket = slab;
+    slab->partialnext = class->partial;
+    class->partial = slab;
+    return slab;
+}
+
+// Allocate a small object from ZoneTmpHigh.
+static void *
+slabAlloc(u32 size)
+{
+    int classidx = 0;
+    while (SizeClasses[classidx].size < size)
+        if (++classidx >= ARRAY_SIZE(SizeClasses))
+            return NULL;
+    struct sizeclass_s *class = &SizeClasses[classidx];
+    struct slab_s *slab = class->partial;
+    if (!slab) {
+        slab = slabGrow(classidx);
+        if (!slab)
+            return NULL;
+    }
+    void *obj = slab->freelist;
+    slab->freelist = *(void**)obj;
+    slab->inuse++;
+    if (!slab->freelist)
+        // Slab is now full.
+        class->partial = slab->partialnext;
+    return obj;
+}
+
+static void
+slabFree(struct slab_s *slab, void *obj)
+{
+    if (!slab->freelist) {
+        // Slab was full - make it available again.
+        struct sizeclass_s *class = slabClass(slab);
+        slab->partialnext = class->partial;
+        class->partial = slab;
+    }
+    *(void**)obj = slab->freelist;
+    slab->freelist = obj;
+    slab->inuse--;
+}
+
+// Update allocation statistics.
+static struct alloctag_s *
+zoneStatsAdd(struct zone_s *zone, u32 size, const char *tag, int tracked)
+{
+    zone->count++;
+    zone->used += size;
+    if (zone->used > zone->peak)
+        zone->peak = zone->used;
+    struct alloctag_s *t = findTag(tag, zone);
+    if (!t)
+        return NULL;
+    t->count++;
+    t->total += size;
+    if (!tracked)
+        return t;
+    t->used += size;
+    if (t->used > t->peak)
+        t->peak = t->used;
+    return t;
+}
+
+// Allocate pmm bookkeeping information.
+static struct allocdetail_s *
+allocDetail(void)
+{
+    struct allocdetail_s *detail = slabAlloc(sizeof(*detail));
+    if (detail)
+        return detail;
+    return allocSpace(&ZoneTmpLow, sizeof(*detail), MALLOC_MIN_ALIGN, NULL);
+}
+
+static void
+freeDetail(struct allocdetail_s *detail)
+{
+    struct slab_s *slab = slabFind(detail);
+    if (slab)
+        slabFree(slab, detail);
+    else
+        freeSpace(&detail->detailinfo);
+}
+
+
 /****************************************************************
  * tracked memory allocations
  ****************************************************************/
 
 // Allocate memory from the given zone and track it as a PMM allocation
 void * __malloc
-pmm_malloc(struct zone_s *zone, u32 handle, u32 size, u32 align)
+pmm_malloc(struct zone_s *zone, u32 handle, u32 size, u32 align
+           , const char *tag)
 {
     ASSERT32FLAT();
     if (!size)
         return NULL;
 
+    // Small untracked temporary allocations come from a size class.
+    if (zone == &ZoneTmpHigh && handle == PMM_DEFAULT_HANDLE
+        && align <= MALLOC_MIN_ALIGN) {
+        void *data = slabAlloc(size);
+        if (data) {
+            dprintf(8, "pmm_malloc slab size=%d ret=%p\n", size, data);
+            // Small temporary allocations are counted, but their use
+            // isn't tracked on free.
+            zoneStatsAdd(zone, slabClass(slabFind(data))->size, tag, 0);
+            return data;
+        }
+    }
+
     // Find and reserve space for bookkeeping.
-    struct allocdetail_s *detail = allocSpace(
-        &ZoneTmpHigh, sizeof(*detail), MALLOC_MIN_ALIGN, NULL);
+    struct allocdetail_s *detail = allocDetail();
     if (!detail) {
-        detail = allocSpace(&ZoneTmpLow, sizeof(*detail)
-                            , MALLOC_MIN_ALIGN, NULL);
-        if (!detail)
-            return NULL;
+        zone->fails++;
+        return NULL;
     }
 
     // Find and reserve space for main allocation
-    void *data = allocExpandSpace(zone, size, align, &detail->datainfo);
+    void *data = allocExpandSpace(zone, size, align, &detail->datainfo, tag);
     if (!data) {
-        freeSpace(&detail->detailinfo);
+        freeDetail(detail);
+        zone->fails++;
         return NULL;
     }
 
@@ -362,6 +789,9 @@ pmm_malloc(struct zone_s *zone, u32 handle, u32 size, u32 align)
             , zone, handle, size, align
             , data, detail);
     detail->handle = handle;
+    detail->zone = zone;
+    detail->tag = zoneStatsAdd(zone, size, tag, 1);
+    addAllocHash(detail);
 
     return data;
 }
@@ -371,17 +801,42 @@ int
 pmm_free(void *data)
 {
     ASSERT32FLAT();
-    struct allocinfo_s *info = findAlloc(data);
-    if (!info || data == (void*)info || data == info->dataend)
+    struct slab_s *slab = slabFind(data);
+    if (slab) {
+        dprintf(8, "pmm_free %p (slab=%p)\n", data, slab);
+        if (CONFIG_SCRUB_RAM && ScrubDone)
+            // Allocated before the scrub - clear it now.
+            memset(data, 0, slabClass(slab)->size);
+        ZoneTmpHigh.used -= slabClass(slab)->size;
+        slabFree(slab, data);
+        return 0;
+    }
+    struct allocdetail_s *detail = findAllocHash(data, 1);
+    if (!detail)
         return -1;
-    struct allocdetail_s *detail = container_of(
-        info, struct allocdetail_s, datainfo);
     dprintf(8, "pmm_free %p (detail=%p)\n", data, detail);
-    freeSpace(info);
-    freeSpace(&detail->detailinfo);
+    u32 size = detail->datainfo.dataend - detail->datainfo.data;
+    if (CONFIG_SCRUB_RAM && ScrubDone)
+        memset(data, 0, size);
+    detail->zone->used -= size;
+    if (detail->tag)
+        detail->tag->used -= size;
+    freeSpace(&detail->datainfo);
+    freeDetail(detail);
     return 0;
 }
 
+// Return the number of allocations made from all zones so far.
+u32
+malloc_count(void)
+{
+    u32 count = 0;
+    int i;
+    for (i=0; i<ARRAY_SIZE(Zones); i++)
+        count += Zones[i]->count;
+    return count;
+}
+
 // Find the amount of free space in a given zone.
 static u32
 pmm_getspace(struct zone_s *zone)
@@ -409,19 +864,11 @@ pmm_getspace(struct zone_s *zone)
 static void *
 pmm_find(u32 handle)
 {
-    int i;
-    for (i=0; i<ARRAY_SIZE(Zones); i++) {
-        struct zone_s *zone = Zones[i];
-        struct allocinfo_s *info;
-        for (info = zone->info; info; info = info->next) {
-            if (info->data != (void*)info)
-                continue;
-            struct allocdetail_s *detail = container_of(
-                info, struct allocdetail_s, detailinfo);
-            if (detail->handle == handle)
-                return detail->datainfo.data;
-        }
-    }
+    struct allocdetail_s *detail;
+    for (detail = HandleHash[allocHash(handle)]; detail
+             ; detail = detail->handlenext)
+        if (detail->handle == handle)
+            return detail->datainfo.data;
     return NULL;
 }
 
@@ -501,14 +948,14 @@ handle_pmm00(u16 *args)
     case 0:
         return 0;
     case 1:
-        return (u32)pmm_malloc(lowzone, handle, size, align);
+        return (u32)pmm_malloc(lowzone, handle, size, align, "pmm");
     case 2:
-        return (u32)pmm_malloc(highzone, handle, size, align);
+        return (u32)pmm_malloc(highzone, handle, size, align, "pmm");
     case 3: {
-        void *data = pmm_malloc(lowzone, handle, size, align);
+        void *data = pmm_malloc(lowzone, handle, size, align, "pmm");
         if (data)
             return (u32)data;
-        return (u32)pmm_malloc(highzone, handle, size, align);
+        return (u32)pmm_malloc(highzone, handle, size, align, "pmm");
     }
     }
 }
@@ -138,11 +138,18 @@ ram_probe(void)
     u32 count = qemu_cfg_e820_entries();
     if (count) {
         struct e820_reservation entry;
-        int i;
+        struct e820entry batch[16];
+        int i, n = 0;
 
         for (i = 0; i < count; i++) {
             qemu_cfg_e820_load_next(&entry);
-            add_e820(entry.address, entry.length, entry.type);
+            batch[n].start = entry.address;
+            batch[n].size = entry.length;
+            batch[n].type = entry.type;
+            if (++n == ARRAY_SIZE(batch) || i == count-1) {
+                add_e820_list(batch, n);
+                n = 0;
+            }
         }
     } else if (kvm_para_available()) {
         // Backwards compatibility - provide hard coded range.
@@ -176,22 +183,32 @@ init_bios_tables(void)
     acpi_bios_init();
 }
 
-// Initialize hardware devices
+// Initialize hardware devices (of the given BOOT_INIT_* types)
 static void
-init_hw(void)
+init_hw(int mask)
 {
-    usb_setup();
-    ps2port_setup();
-    lpt_setup();
-    serial_setup();
-
-    floppy_setup();
-    ata_setup();
-    ahci_setup();
-    cbfs_payload_setup();
-    ramdisk_setup();
-    virtio_blk_setup();
-    xenbus_setup();
+    if (mask & BOOT_INIT_USB)
+        usb_setup();
+    if (mask & BOOT_INIT_BASE) {
+        ps2port_setup();
+        lpt_setup();
+        serial_setup();
+    }
+
+    if (mask & BOOT_INIT_FLOPPY)
+        floppy_setup();
+    if (mask & BOOT_INIT_ATA)
+        ata_setup();
+    if (mask & BOOT_INIT_AHCI)
+        ahci_setup();
+    if (mask & BOOT_INIT_BASE) {
+        cbfs_payload_setup();
+        ramdisk_setup();
+    }
+    if (mask & BOOT_INIT_VIRTIO)
+        virtio_blk_setup();
+    if (mask & BOOT_INIT_BASE)
+        xenbus_setup();
 }
 
 // Begin the boot process by invoking an int0x19 in 16bit mode.
@@ -215,6 +232,9 @@ maininit(void)
     // Running at new code address - do code relocation fixups
     malloc_fixupreloc();
 
+    // Check for a full init request from a failed fast boot.
+    boot_check_fullinit();
+
     // Setup ivt/bda/ebda
     init_ivt();
     init_bda();
@@ -227,6 +247,9 @@ maininit(void)
     // Initialize mtrr
     mtrr_setup();
 
+    // Measure memory copy performance (if enabled)
+    membench();
+
     // Initialize pci
     pci_setup();
     smm_init();
@@ -236,10 +259,11 @@ maininit(void)
 
     // Initialize internal tables
     boot_setup();
+    int initmask = boot_init_mask();
 
     // Start hardware initialization (if optionrom threading)
     if (CONFIG_THREADS && CONFIG_THREAD_OPTIONROMS)
-        init_hw();
+        init_hw(initmask);
 
     // Find and initialize other cpus
     smp_probe();
@@ -257,12 +281,25 @@ maininit(void)
 
     // Do hardware initialization (if running synchronously)
     if (!CONFIG_THREADS || !CONFIG_THREAD_OPTIONROMS) {
-        init_hw();
+        init_hw(initmask);
         wait_threads();
     }
 
     // Run option roms
-    optionrom_setup();
+    if (initmask & BOOT_INIT_ROMS)
+        optionrom_setup();
+
+    // Fast boot - initialize the rest if the boot device wasn't found.
+    if (initmask != BOOT_INIT_ALL) {
+        wait_threads();
+        int rest = boot_init_remaining(initmask);
+        if (rest) {
+            init_hw(rest);
+            wait_threads();
+            if (rest & BOOT_INIT_ROMS)
+                optionrom_setup();
+        }
+    }
 
     // Run BCVs and show optional boot menu
     boot_prep();
@@ -270,8 +307,9 @@ maininit(void)
     // Finalize data structures before boot
     cdemu_setup();
     pmm_finalize();
-    malloc_finalize();
     memmap_finalize();
+    malloc_finalize();
+    memmap_report();
 
     // Setup bios checksum.
     BiosChecksum -= checksum((u8*)BUILD_BIOS_ADDR, BUILD_BIOS_SIZE);
@@ -297,6 +335,9 @@ updateRelocs(void *dest, u32 *rstart, u32 *rend, u32 delta)
         *((u32*)(dest + *reloc)) += delta;
 }
 
+// Distance the init code and data were moved by reloc_init().
+s32 InitRelocDelta;
+
 // Relocate init code and then call maininit() at new address.
 static void
 reloc_init(void)
@@ -324,6 +365,7 @@ reloc_init(void)
     dprintf(1, "Relocating init from %p to %p (size %d)\n"
             , code32init_start, dest, initsize);
     s32 delta = dest - (void*)code32init_start;
+    InitRelocDelta = delta;
     memcpy(dest, code32init_start, initsize);
     updateRelocs(dest, _reloc_abs_start, _reloc_abs_end, delta);
     updateRelocs(dest, _reloc_rel_start, _reloc_rel_end, -delta);
@@ -152,7 +152,10 @@ qemu_prep_reset(void)
     // QEMU doesn't map 0xc0000-0xfffff back to the original rom on a
     // reset, so do that manually before invoking a hard reset.
     make_bios_writable();
+    u32 romcache = optionrom_cache_check();
     extern u8 code32flat_start[], code32flat_end[];
     memcpy(code32flat_start, code32flat_start + BIOS_SRC_OFFSET
            , code32flat_end - code32flat_start);
+    // Let the next boot know the option rom cache is still intact.
+    RomCachePrev = romcache;
 }
@@ -8,7 +8,8 @@
 #include "util.h" // dprintf
 #include "config.h" // CONFIG_*
 #include "cmos.h" // CMOS_BIOS_SMP_COUNT
-#include "paravirt.h"
+#include "paravirt.h" // qemu_cfg_get_max_cpus
+#include "bregs.h" // CR0_PE
 
 #define APIC_ICR_LOW ((u8*)BUILD_APIC_ADDR + 0x300)
 #define APIC_SVR     ((u8*)BUILD_APIC_ADDR + 0x0F0)
@@ -36,6 +37,19 @@ wrmsr_smp(u32 index, u64 val)
 
 u32 CountCPUs VAR16VISIBLE;
 u32 MaxCountCPUs VAR16VISIBLE;
+
+// Per-cpu work dispatch.  Each application processor claims a slot
+// (and thus a private stack) with an atomic increment of
+// SMPWorkIndex, runs SMPWorkEntry in 32bit flat mode, and then
+// reports completion by incrementing SMPWorkDone.
+#define SMP_STACK_SIZE 1024
+#define SMP_MAX_WORK 4
+#define SMP_DEFAULT_STACKS 64
+
+u32 SMPWorkEntry VAR16VISIBLE;
+u32 SMPStackBase VAR16VISIBLE, SMPStackCount VAR16VISIBLE;
+u32 SMPWorkIndex VAR16VISIBLE, SMPWorkDone VAR16VISIBLE;
+
 extern void smp_ap_boot_code(void);
 ASM16(
     "  .global smp_ap_boot_code\n"
@@ -62,29 +76,165 @@ ASM16(
     // Increment the cpu counter
     "  lock incl CountCPUs\n"
 
+    // Claim a work slot (and stack) if there is per-cpu work
+    "  movl SMPWorkEntry, %edi\n"
+    "  testl %edi, %edi\n"
+    "  jz 3f\n"
+    "  movl $1, %ebx\n"
+    "  lock xaddl %ebx, SMPWorkIndex\n"
+    "  cmpl SMPStackCount, %ebx\n"
+    "  jae 3f\n"
+    "  leal 1(%ebx), %esp\n"
+    "  imull $" __stringify(SMP_STACK_SIZE) ", %esp\n"
+    "  addl SMPStackBase, %esp\n"
+
+    // Enter 32bit flat mode (a20 is already enabled by the main cpu)
+    "  lgdtw rombios32_gdt_48\n"
+    "  movl %cr0, %eax\n"
+    "  orl $" __stringify(CR0_PE) ", %eax\n"
+    "  movl %eax, %cr0\n"
+    "  ljmpl $" __stringify(SEG32_MODE32_CS) ", $(" __stringify(BUILD_BIOS_ADDR) " + 4f)\n"
+    "  .code32\n"
+    "4:movl $" __stringify(SEG32_MODE32_DS) ", %eax\n"
+    "  movw %ax, %ds\n"
+    "  movw %ax, %es\n"
+    "  movw %ax, %ss\n"
+    "  movw %ax, %fs\n"
+    "  movw %ax, %gs\n"
+
+    // Run the work (cpu number in %eax) and report completion
+    "  leal 1(%ebx), %eax\n"
+    "  calll *%edi\n"
+    "  lock incl " __stringify(BUILD_BIOS_ADDR) " + SMPWorkDone\n"
+    "5:hlt\n"
+    "  jmp 5b\n"
+    "  .code16gcc\n"
+
     // Halt the processor.
-    "1:hlt\n"
-    "  jmp 1b\n"
+    "3:hlt\n"
+    "  jmp 3b\n"
     );
 
+static void (*SMPWork[SMP_MAX_WORK])(u32 cpu);
+static int SMPWorkCount;
+
+// Register a function to be run on every cpu during smp_probe().
+// The function is called concurrently on all cpus (with the cpu
+// number as its argument) on a small private stack - it must not
+// allocate memory, yield, or rely on other cpus.
+void
+smp_queue_work(void (*func)(u32 cpu))
+{
+    ASSERT32FLAT();
+    if (SMPWorkCount >= ARRAY_SIZE(SMPWork)) {
+        warn_noalloc();
+        return;
+    }
+    SMPWork[SMPWorkCount++] = func;
+}
+
+static void
+smp_run_work(u32 cpu)
+{
+    int i;
+    for (i=0; i<SMPWorkCount; i++)
+        SMPWork[i](cpu);
+}
+
+// Topology discovery - record the initial apic id of each cpu.
+static u8 *SMPApicIds;
+
+static void
+smp_topology(u32 cpu)
+{
+    u32 eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    SMPApicIds[cpu] = ebx >> 24;
+}
+
+// Allocate the per-cpu stacks used by smp_run_work().
+static void
+smp_work_setup(void)
+{
+    u32 aps = qemu_cfg_get_max_cpus();
+    aps = aps ? aps - 1 : SMP_DEFAULT_STACKS;
+    SMPApicIds = malloc_tmphigh(aps + 1);
+    if (!SMPApicIds) {
+        warn_noalloc();
+        return;
+    }
+    memset(SMPApicIds, 0, aps + 1);
+    smp_queue_work(smp_topology);
+    if (!aps)
+        // Only the main cpu - no stacks needed.
+        return;
+
+    void *stacks = malloc_tmphigh(aps * SMP_STACK_SIZE);
+    if (!stacks) {
+        // The work is still run on the main cpu.
+        warn_noalloc();
+        return;
+    }
+
+    SMPStackBase = (u32)stacks;
+    SMPStackCount = aps;
+    SMPWorkIndex = SMPWorkDone = 0;
+    SMPWorkEntry = (u32)smp_run_work;
+}
+
+// Run the per-cpu work on the main cpu and wait for the other cpus.
+static void
+smp_work_finish(void)
+{
+    smp_run_work(0);
+    u32 workers = 0;
+    if (SMPWorkEntry) {
+        // Close the work slots so that a late cpu can't claim one (any
+        // later claim gets an index past SMPStackCount and just halts),
+        // then wait for the cpus that did claim a slot.
+        writel(&SMPWorkEntry, 0);
+        workers = SMPStackCount;
+        asm volatile("xchgl %0, %1" : "+r"(workers), "+m"(SMPWorkIndex)
+                     : : "memory");
+        if (workers > SMPStackCount)
+            workers = SMPStackCount;
+        while (readl(&SMPWorkDone) < workers)
+            yield();
+        free((void*)SMPStackBase);
+    }
+
+    if (SMPApicIds) {
+        int i;
+        for (i=0; i<=workers; i++)
+            dprintf(3, "cpu %d: apic id %d\n", i, SMPApicIds[i]);
+        free(SMPApicIds);
+        SMPApicIds = NULL;
+    }
+    scrub_finish();
+}
+
 // find and initialize the CPUs by launching a SIPI to them
 void
 smp_probe(void)
 {
     ASSERT32FLAT();
+    // Init the counter.
+    writel(&CountCPUs, 1);
+
+    // Prepare per-cpu work.
+    smp_work_setup();
+    scrub_setup();
+
     u32 eax, ebx, ecx, cpuid_features;
     cpuid(1, &eax, &ebx, &ecx, &cpuid_features);
     if (eax < 1 || !(cpuid_features & CPUID_APIC)) {
         // No apic - only the main cpu is present.
         dprintf(1, "No apic - only the main cpu is present.\n");
-        CountCPUs= 1;
         MaxCountCPUs = 1;
+        smp_work_finish();
         return;
     }
 
-    // Init the counter.
-    writel(&CountCPUs, 1);
-
     // Setup jump trampoline to counter code.
     u64 old = *(u64*)BUILD_AP_BOOT_ADDR;
     // ljmpw $SEG_BIOS, $(smp_ap_boot_code - BUILD_BIOS_ADDR)
@@ -122,6 +272,8 @@ smp_probe(void)
     // Restore memory.
     *(u64*)BUILD_AP_BOOT_ADDR = old;
 
+    smp_work_finish();
+
     MaxCountCPUs = qemu_cfg_get_max_cpus();
     if (!MaxCountCPUs || MaxCountCPUs < CountCPUs)
         MaxCountCPUs = CountCPUs;
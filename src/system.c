@@ -290,8 +290,11 @@ handle_15e801(struct bregs *regs)
     set_success(regs);
 }
 
-// Info on e820 map location and size.
-struct e820entry e820_list[CONFIG_MAX_E820] VAR16VISIBLE;
+// Info on e820 map location and size.  The map is built in
+// e820_initial and may be moved elsewhere under 1Meg if it grows
+// (e820_list holds its flat address).
+struct e820entry e820_initial[CONFIG_MAX_E820] VAR16VISIBLE;
+struct e820entry *e820_list VAR16VISIBLE;
 int e820_count VAR16VISIBLE;
 
 static void
@@ -304,9 +307,10 @@ handle_15e820(struct bregs *regs)
         return;
     }
 
+    struct e820entry *e = &GET_GLOBAL(e820_list)[regs->bx];
     memcpy_far(regs->es, (void*)(regs->di+0)
-               , get_global_seg(), &e820_list[regs->bx]
-               , sizeof(e820_list[0]));
+               , FLATPTR_TO_SEG(e), (void*)FLATPTR_TO_OFFSET(e)
+               , sizeof(*e));
     if (regs->bx == count-1)
         regs->ebx = 0;
     else
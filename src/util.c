@@ -7,6 +7,7 @@
 #include "util.h" // call16
 #include "bregs.h" // struct bregs
 #include "config.h" // BUILD_STACK_ADDR
+#include "biosvar.h" // GET_GLOBAL
 
 
 /****************************************************************
@@ -142,9 +143,79 @@ memset16_far(u16 d_seg, void *d_far, u16 c, size_t len)
         : "cc", "memory");
 }
 
+// Memory copy/fill strategy for 32bit flat mode (detected on first use).
+#define MEMOP_DETECTED 1
+#define MEMOP_ERMS     2 // "rep movsb/stosb" is fast for any alignment
+#define MEMOP_NT       4 // movnti non-temporal stores available
+static int MemOpFlags;
+// Blocks at least this large bypass the cache.
+#define MEMOP_NT_THRESHOLD (256*1024)
+
+static int
+memop_flags(void)
+{
+    int flags = MemOpFlags;
+    if (flags)
+        return flags;
+    flags = MEMOP_DETECTED;
+    u32 eax, ebx, ecx, edx, maxleaf;
+    cpuid(0, &maxleaf, &ebx, &ecx, &edx);
+    if (maxleaf >= 1) {
+        cpuid(1, &eax, &ebx, &ecx, &edx);
+        if (edx & CPUID_SSE2)
+            flags |= MEMOP_NT;
+    }
+    if (maxleaf >= 7) {
+        cpuid(7, &eax, &ebx, &ecx, &edx);
+        if (ebx & CPUID_ERMS)
+            flags |= MEMOP_ERMS;
+    }
+    MemOpFlags = flags;
+    return flags;
+}
+
+// Fill memory in 32bit flat mode.
+static void
+memset_flat(void *s, u8 c, size_t n)
+{
+    int flags = memop_flags();
+    if (n < 16 || (flags & MEMOP_ERMS && n < MEMOP_NT_THRESHOLD)) {
+        asm volatile("rep stosb" : "+c"(n), "+D"(s) : "a"(c) : "cc", "memory");
+        return;
+    }
+    // Align the destination, fill with words, then fill the tail.
+    u32 val = c * 0x01010101;
+    u32 head = -(u32)s & 15;
+    n -= head;
+    asm volatile("rep stosb" : "+c"(head), "+D"(s) : "a"(val) : "cc", "memory");
+    u32 count = n / 16;
+    if (flags & MEMOP_NT && n >= MEMOP_NT_THRESHOLD) {
+        asm volatile(
+            "1:movnti %2, 0(%0)\n"
+            "  movnti %2, 4(%0)\n"
+            "  movnti %2, 8(%0)\n"
+            "  movnti %2, 12(%0)\n"
+            "  addl $16, %0\n"
+            "  decl %1\n"
+            "  jnz 1b\n"
+            "  sfence\n"
+            : "+r"(s), "+r"(count) : "r"(val) : "cc", "memory");
+    } else {
+        count *= 4;
+        asm volatile("rep stosl" : "+c"(count), "+D"(s) : "a"(val)
+                     : "cc", "memory");
+    }
+    n &= 15;
+    asm volatile("rep stosb" : "+c"(n), "+D"(s) : "a"(val) : "cc", "memory");
+}
+
 void *
 memset(void *s, int c, size_t n)
 {
+    if (!MODESEGMENT) {
+        memset_flat(s, c, n);
+        return s;
+    }
     while (n)
         ((char *)s)[--n] = c;
     return s;
@@ -185,6 +256,50 @@ memcpy_fl(void *d_fl, const void *s_fl, size_t len)
         memcpy(d_fl, s_fl, len);
 }
 
+// Copy memory in 32bit flat mode.
+static void
+memcpy_flat(void *d, const void *s, size_t len)
+{
+    int flags = memop_flags();
+    if (len < 16 || (flags & MEMOP_ERMS && len < MEMOP_NT_THRESHOLD)) {
+        asm volatile("rep movsb" : "+c"(len), "+S"(s), "+D"(d)
+                     : : "cc", "memory");
+        return;
+    }
+    // Align the destination, copy with words, then copy the tail.
+    u32 head = -(u32)d & 15;
+    len -= head;
+    asm volatile("rep movsb" : "+c"(head), "+S"(s), "+D"(d)
+                 : : "cc", "memory");
+    u32 count = len / 16;
+    if (flags & MEMOP_NT && len >= MEMOP_NT_THRESHOLD) {
+        u32 t1, t2;
+        asm volatile(
+            "1:movl 0(%2), %0\n"
+            "  movl 4(%2), %1\n"
+            "  movnti %0, 0(%3)\n"
+            "  movnti %1, 4(%3)\n"
+            "  movl 8(%2), %0\n"
+            "  movl 12(%2), %1\n"
+            "  movnti %0, 8(%3)\n"
+            "  movnti %1, 12(%3)\n"
+            "  addl $16, %2\n"
+            "  addl $16, %3\n"
+            "  decl %4\n"
+            "  jnz 1b\n"
+            "  sfence\n"
+            : "=&r"(t1), "=&r"(t2), "+r"(s), "+r"(d), "+r"(count)
+            : : "cc", "memory");
+    } else {
+        count *= 4;
+        asm volatile("rep movsl" : "+c"(count), "+S"(s), "+D"(d)
+                     : : "cc", "memory");
+    }
+    len &= 15;
+    asm volatile("rep movsb" : "+c"(len), "+S"(s), "+D"(d)
+                 : : "cc", "memory");
+}
+
 void *
 #undef memcpy
 memcpy(void *d1, const void *s1, size_t len)
@@ -192,6 +307,10 @@ memcpy(void *d1, const void *s1, size_t len)
 #define memcpy __builtin_memcpy
 #endif
 {
+    if (!MODESEGMENT) {
+        memcpy_flat(d1, s1, len);
+        return d1;
+    }
     SET_SEG(ES, GET_SEG(SS));
     void *d = d1;
     if (((u32)d1 | (u32)s1 | len) & 3) {
@@ -237,20 +356,97 @@ iomemcpy(void *d, const void *s, u32 len)
 void *
 memmove(void *d, const void *s, size_t len)
 {
-    if (s >= d)
-        return memcpy(d, s, len);
+    if (MODESEGMENT) {
+        if (s >= d)
+            return memcpy(d, s, len);
 
-    d += len-1;
-    s += len-1;
-    while (len--) {
-        *(char*)d = *(char*)s;
-        d--;
-        s--;
+        d += len-1;
+        s += len-1;
+        while (len--) {
+            *(char*)d = *(char*)s;
+            d--;
+            s--;
+        }
+
+        return d;
     }
 
+    if (s >= d || s + len <= d)
+        return memcpy(d, s, len);
+
+    // Overlapping copy to a higher address - copy backwards.
+    if (!(((u32)d | (u32)s | len) & 3)) {
+        u32 count = len / 4;
+        const void *sp = s + len - 4;
+        void *dp = d + len - 4;
+        asm volatile(
+            "std\n"
+            "rep movsl (%%esi),%%es:(%%edi)\n"
+            "cld"
+            : "+c"(count), "+S"(sp), "+D"(dp)
+            : : "cc", "memory");
+        return d;
+    }
+    const void *sp = s + len - 1;
+    void *dp = d + len - 1;
+    asm volatile(
+        "std\n"
+        "rep movsb (%%esi),%%es:(%%edi)\n"
+        "cld"
+        : "+c"(len), "+S"(sp), "+D"(dp)
+        : : "cc", "memory");
     return d;
 }
 
+// Measure the flat mode copy and fill kernels (CONFIG_DEBUG_MEMBENCH).
+void
+membench(void)
+{
+    ASSERT32FLAT();
+    if (!CONFIG_DEBUG_MEMBENCH)
+        return;
+    u32 size = 4*1024*1024;
+    u8 *buf = malloc_tmphigh(size * 2 + 64);
+    u32 mhz = GET_GLOBAL(cpu_khz) / 1000;
+    if (!mhz) {
+        dprintf(1, "membench: cpu frequency unknown - skipping\n");
+        free(buf);
+        return;
+    }
+    if (!buf) {
+        warn_noalloc();
+        return;
+    }
+    u32 sizes[] = { 4*1024, 64*1024, 1024*1024, size };
+    int i;
+    for (i=0; i<ARRAY_SIZE(sizes); i++) {
+        u32 len = sizes[i], reps = size / len, j, t[4];
+        u64 start = rdtscll();
+        for (j=0; j<reps; j++)
+            memset(buf, j, len);
+        t[0] = rdtscll() - start;
+        start = rdtscll();
+        for (j=0; j<reps; j++)
+            memcpy(buf + size, buf, len);
+        t[1] = rdtscll() - start;
+        start = rdtscll();
+        for (j=0; j<reps; j++)
+            memcpy(buf + size + 1, buf + 3, len);
+        t[2] = rdtscll() - start;
+        start = rdtscll();
+        for (j=0; j<reps; j++)
+            memmove(buf + 4, buf, len);
+        t[3] = rdtscll() - start;
+        // Bytes per microsecond is MB/s.
+        for (j=0; j<ARRAY_SIZE(t); j++)
+            t[j] = size / ((t[j] / mhz) ?: 1);
+        dprintf(1, "membench %u bytes (MB/s): memset=%u memcpy=%u"
+                " memcpy_unaligned=%u memmove=%u\n"
+                , len, t[0], t[1], t[2], t[3]);
+    }
+    free(buf);
+}
+
 // Copy a string - truncating it if necessary.
 char *
 strtcpy(char *dest, const char *src, size_t len)
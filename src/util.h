@@ -54,11 +54,13 @@ static inline void wbinvd(void)
 #define CPUID_MSR (1 << 5)
 #define CPUID_APIC (1 << 9)
 #define CPUID_MTRR (1 << 12)
+#define CPUID_SSE2 (1 << 26)
+#define CPUID_ERMS (1 << 9)  // cpuid leaf 7 ebx
 static inline void cpuid(u32 index, u32 *eax, u32 *ebx, u32 *ecx, u32 *edx)
 {
     asm("cpuid"
         : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
-        : "0" (index));
+        : "0" (index), "2" (0));
 }
 
 static inline u32 getcr0(void) {
@@ -129,6 +131,11 @@ static inline u32 cpu_to_le32(u32 x)
     return x;
 }
 
+static inline u64 cpu_to_le64(u64 x)
+{
+    return x;
+}
+
 static inline u32 getesp(void) {
     u32 esp;
     asm("movl %%esp, %0" : "=rm"(esp));
@@ -217,6 +224,7 @@ void *memcpy(void *d1, const void *s1, size_t len);
 #endif
 void iomemcpy(void *d, const void *s, u32 len);
 void *memmove(void *d, const void *s, size_t len);
+void membench(void);
 char *strtcpy(char *dest, const char *src, size_t len);
 char *strchr(const char *s, int c);
 void nullTrailingSpace(char *buf);
@@ -321,6 +329,7 @@ void lpt_setup(void);
 // clock.c
 #define PIT_TICK_RATE 1193180   // Underlying HZ of PIT
 #define PIT_TICK_INTERVAL 65536 // Default interval for 18.2Hz timer
+extern u32 cpu_khz;
 static inline int check_tsc(u64 end) {
     return (s64)(rdtscll() - end) > 0;
 }
@@ -365,21 +374,29 @@ void smm_init(void);
 extern u32 CountCPUs;
 extern u32 MaxCountCPUs;
 void wrmsr_smp(u32 index, u64 val);
+void smp_queue_work(void (*func)(u32 cpu));
 void smp_probe(void);
 
 // coreboot.c
 extern const char *CBvendor, *CBpart;
+int ulzma(u8 *dst, u32 maxlen, const u8 *src, u32 srclen);
 struct cbfs_file;
 struct cbfs_file *cbfs_finddatafile(const char *fname);
 struct cbfs_file *cbfs_findprefix(const char *prefix, struct cbfs_file *last);
 u32 cbfs_datasize(struct cbfs_file *file);
 const char *cbfs_filename(struct cbfs_file *file);
 int cbfs_copyfile(struct cbfs_file *file, void *dst, u32 maxlen);
+int cbfs_copyhead(struct cbfs_file *file, void *dst, u32 len);
 void cbfs_run_payload(struct cbfs_file *file);
 void coreboot_copy_biostable(void);
 void cbfs_payload_setup(void);
 void coreboot_setup(void);
 
+// lz4decode.c
+int ulz4f(u8 *dst, u32 maxlen, const u8 *src, u32 srclen);
+int ulz4f_head(u8 *dst, u32 len, const u8 *src, u32 srclen);
+int ulz4f_size(const u8 *src, u32 srclen);
+
 // biostable.c
 void copy_pir(void *pos);
 void copy_mptable(void *pos);
@@ -396,7 +413,8 @@ void call_bcv(u16 seg, u16 ip);
 void optionrom_setup(void);
 void vga_setup(void);
 void s3_resume_vga_init(void);
-extern u32 RomEnd;
+u32 optionrom_cache_check(void);
+extern u32 RomEnd, RomCachePrev;
 extern int ScreenAndDebug;
 
 // bootsplash.c
@@ -408,6 +426,9 @@ void disable_bootsplash(void);
 extern int HaveRunPost;
 void init_dma(void);
 
+// post.c
+extern s32 InitRelocDelta;
+
 // pnpbios.c
 #define PNP_SIGNATURE 0x506e5024 // $PnP
 u16 get_pnp_offset(void);
@@ -415,55 +436,45 @@ void pnp_setup(void);
 
 // pmm.c
 extern struct zone_s ZoneLow, ZoneHigh, ZoneFSeg, ZoneTmpLow, ZoneTmpHigh;
+extern void *RomCacheSpace;
 void malloc_setup(void);
 void malloc_fixupreloc(void);
 void malloc_finalize(void);
-void *pmm_malloc(struct zone_s *zone, u32 handle, u32 size, u32 align);
+void *pmm_malloc(struct zone_s *zone, u32 handle, u32 size, u32 align
+                 , const char *tag);
 int pmm_free(void *data);
+u32 malloc_count(void);
 void pmm_setup(void);
 void pmm_finalize(void);
+void scrub_setup(void);
+void scrub_finish(void);
 #define PMM_DEFAULT_HANDLE 0xFFFFFFFF
 // Minimum alignment of malloc'd memory
 #define MALLOC_MIN_ALIGN 16
-// Helper functions for memory allocation.
-static inline void *malloc_low(u32 size) {
-    return pmm_malloc(&ZoneLow, PMM_DEFAULT_HANDLE, size, MALLOC_MIN_ALIGN);
-}
-static inline void *malloc_high(u32 size) {
-    return pmm_malloc(&ZoneHigh, PMM_DEFAULT_HANDLE, size, MALLOC_MIN_ALIGN);
-}
-static inline void *malloc_fseg(u32 size) {
-    return pmm_malloc(&ZoneFSeg, PMM_DEFAULT_HANDLE, size, MALLOC_MIN_ALIGN);
-}
-static inline void *malloc_tmplow(u32 size) {
-    return pmm_malloc(&ZoneTmpLow, PMM_DEFAULT_HANDLE, size, MALLOC_MIN_ALIGN);
-}
-static inline void *malloc_tmphigh(u32 size) {
-    return pmm_malloc(&ZoneTmpHigh, PMM_DEFAULT_HANDLE, size, MALLOC_MIN_ALIGN);
-}
-static inline void *malloc_tmp(u32 size) {
-    void *ret = malloc_tmphigh(size);
-    if (ret)
-        return ret;
-    return malloc_tmplow(size);
-}
-static inline void *memalign_low(u32 align, u32 size) {
-    return pmm_malloc(&ZoneLow, PMM_DEFAULT_HANDLE, size, align);
-}
-static inline void *memalign_high(u32 align, u32 size) {
-    return pmm_malloc(&ZoneHigh, PMM_DEFAULT_HANDLE, size, align);
-}
-static inline void *memalign_tmplow(u32 align, u32 size) {
-    return pmm_malloc(&ZoneTmpLow, PMM_DEFAULT_HANDLE, size, align);
-}
-static inline void *memalign_tmphigh(u32 align, u32 size) {
-    return pmm_malloc(&ZoneTmpHigh, PMM_DEFAULT_HANDLE, size, align);
-}
-static inline void *memalign_tmp(u32 align, u32 size) {
-    void *ret = memalign_tmphigh(align, size);
+// Helper functions for memory allocation.  The calling source file is
+// recorded for the allocation report in malloc_finalize().
+#define malloc_low(size) memalign_low(MALLOC_MIN_ALIGN, (size))
+#define malloc_high(size) memalign_high(MALLOC_MIN_ALIGN, (size))
+#define malloc_fseg(size)                                               \
+    pmm_malloc(&ZoneFSeg, PMM_DEFAULT_HANDLE, (size), MALLOC_MIN_ALIGN  \
+               , __FILE__)
+#define malloc_tmplow(size) memalign_tmplow(MALLOC_MIN_ALIGN, (size))
+#define malloc_tmphigh(size) memalign_tmphigh(MALLOC_MIN_ALIGN, (size))
+#define malloc_tmp(size) memalign_tmp(MALLOC_MIN_ALIGN, (size))
+#define memalign_low(align, size)                                       \
+    pmm_malloc(&ZoneLow, PMM_DEFAULT_HANDLE, (size), (align), __FILE__)
+#define memalign_high(align, size)                                      \
+    pmm_malloc(&ZoneHigh, PMM_DEFAULT_HANDLE, (size), (align), __FILE__)
+#define memalign_tmplow(align, size)                                    \
+    pmm_malloc(&ZoneTmpLow, PMM_DEFAULT_HANDLE, (size), (align), __FILE__)
+#define memalign_tmphigh(align, size)                                   \
+    pmm_malloc(&ZoneTmpHigh, PMM_DEFAULT_HANDLE, (size), (align), __FILE__)
+#define memalign_tmp(align, size) __memalign_tmp((align), (size), __FILE__)
+static inline void *__memalign_tmp(u32 align, u32 size, const char *tag) {
+    void *ret = pmm_malloc(&ZoneTmpHigh, PMM_DEFAULT_HANDLE, size, align, tag);
     if (ret)
         return ret;
-    return memalign_tmplow(align, size);
+    return pmm_malloc(&ZoneTmpLow, PMM_DEFAULT_HANDLE, size, align, tag);
 }
 static inline void free(void *data) {
     pmm_free(data);
@@ -471,6 +482,8 @@ static inline void free(void *data) {
 
 // mtrr.c
 void mtrr_setup(void);
+int mtrr_flash_cache(u32 size);
+void mtrr_flash_uncache(int reg);
 
 // romlayout.S
 void reset_vector(void) __noreturn;
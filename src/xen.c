@@ -136,8 +136,8 @@ void xen_setup(void)
             } else if (end > maxram)
                 maxram = end;
         }
-        add_e820(e->start, e->size, e->type);
     }
+    add_e820_list(e820, info->e820_nr);
 
     RamSize = maxram;
     RamSizeOver4G = maxram_over4G;
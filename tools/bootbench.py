@@ -0,0 +1,355 @@
+#!/usr/bin/env python
+# Boot performance regression benchmark using qemu (works with TCG).
+#
+# Copyright (C) 2026  the SeaBIOS developers <seabios@seabios.org>
+#
+# This file may be distributed under the terms of the GNU GPLv3 license.
+
+# Usage:
+#   tools/bootbench.py [options] out/bios.bin
+#
+# Each configuration in the matrix below is booted until the bios
+# reports a boot attempt.  The debug port (0x402) output is timestamped
+# on the host and split into phases.  With "--io" an additional run is
+# made with qemu port io tracing enabled, and the number of port
+# accesses (io exits under kvm) made during each phase is counted.
+# Results can be saved as a baseline and later runs compared to it.
+
+import sys
+import os
+import re
+import time
+import select
+import struct
+import shutil
+import tempfile
+import subprocess
+import optparse
+import json
+
+# Give up on a boot after this many seconds.
+BOOTTIMEOUT = 120
+# Default regression thresholds (fraction over baseline).
+TIMETOLERANCE = 0.15
+IOTOLERANCE = 0.02
+
+# Phases of boot - a phase starts when its marker is seen in the debug
+# log and ends when the next marker is seen.
+PHASES = [
+    ('post', r'^Start bios'),
+    ('pci', r'^Found \d+ PCI devices'),
+    ('smp', r'^Found \d+ cpu\(s\)'),
+    ('vga', r'^Scan for VGA option rom'),
+    ('optionroms', r'^Scan for option roms'),
+    ('bootmenu', r'^Press F12 for boot menu'),
+    ('boot', r'^(Booting from|No bootable device|Boot failed)'),
+    ]
+ENDMARKER = 'boot'
+
+
+######################################################################
+# Benchmark configurations
+######################################################################
+
+def makeDisk(tmpdir, name, size=64*1024*1024):
+    filename = os.path.join(tmpdir, name)
+    f = open(filename, 'wb')
+    f.truncate(size)
+    f.close()
+    return filename
+
+def makeSplash(tmpdir, width=640, height=480):
+    filename = os.path.join(tmpdir, 'splash.bmp')
+    stride = (width * 3 + 3) & ~3
+    line = "".join([chr(x & 0xff) + chr((x >> 2) & 0xff) + '\x80'
+                    for x in range(width)]) + "\0" * (stride - width*3)
+    data = line * height
+    f = open(filename, 'wb')
+    f.write('BM' + struct.pack('<IHHI', 54 + len(data), 0, 0, 54))
+    f.write(struct.pack('<IiiHHIIiiII', 40, width, height, 1, 24, 0,
+                        len(data), 0, 0, 0, 0))
+    f.write(data)
+    f.close()
+    return filename
+
+def makeFwCfgFiles(tmpdir, count=64, size=4096):
+    args = []
+    for i in range(count):
+        filename = os.path.join(tmpdir, 'fwcfg%d.bin' % (i,))
+        f = open(filename, 'wb')
+        f.write(chr(i & 0xff) * size)
+        f.close()
+        args += ['-fw_cfg', 'name=opt/bootbench/%d,file=%s' % (i, filename)]
+    return args
+
+# Each entry returns the qemu arguments for a configuration.
+CONFIGS = [
+    ('base', lambda t: []),
+    ('ide', lambda t: [
+        '-drive', 'file=%s,if=ide,format=raw' % (makeDisk(t, 'ide.img'),)]),
+    ('ahci', lambda t: [
+        '-device', 'ahci,id=ahci',
+        '-drive', 'id=d0,file=%s,if=none,format=raw' % (
+            makeDisk(t, 'ahci.img'),),
+        '-device', 'ide-hd,drive=d0,bus=ahci.0']),
+    ('virtio-blk', lambda t: [
+        '-drive', 'file=%s,if=virtio,format=raw' % (
+            makeDisk(t, 'virtio.img'),)]),
+    ('usb-msc', lambda t: [
+        '-device', 'usb-ehci,id=ehci',
+        '-drive', 'id=u0,file=%s,if=none,format=raw' % (
+            makeDisk(t, 'usb.img'),),
+        '-device', 'usb-storage,bus=ehci.0,drive=u0']),
+    ('many-pci', lambda t: sum([
+        ['-device', 'e1000,romfile=,netdev=n%d' % (i,),
+         '-netdev', 'user,id=n%d' % (i,)] for i in range(24)], [])),
+    ('fw_cfg', lambda t: makeFwCfgFiles(t)),
+    ('bootsplash', lambda t: [
+        '-boot', 'menu=on,splash-time=0,splash=%s' % (makeSplash(t),)]),
+    ('no-bootsplash', lambda t: ['-boot', 'menu=on,splash-time=0']),
+    ]
+
+
+######################################################################
+# Running qemu
+######################################################################
+
+def qemuArgs(options, bios, extra):
+    return ([options.qemu, '-nodefaults', '-display', 'none', '-vga', 'std',
+             '-machine', 'accel=tcg', '-m', str(options.memory),
+             '-smp', str(options.smp), '-no-reboot',
+             '-bios', bios, '-debugcon', 'stdio']
+            + extra)
+
+# Boot qemu and return a list of (time, line) pairs of debug output.
+def runBoot(args, endre):
+    p = subprocess.Popen(args, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    fd = p.stdout.fileno()
+    lines = []
+    buf = ''
+    starttime = time.time()
+    try:
+        while 1:
+            remaining = starttime + BOOTTIMEOUT - time.time()
+            if remaining <= 0:
+                sys.stderr.write("Timeout waiting for boot\n")
+                return None
+            res = select.select([fd], [], [], remaining)
+            if not res[0]:
+                continue
+            d = os.read(fd, 4096)
+            if not d:
+                sys.stderr.write("qemu exited before boot\n")
+                return None
+            curtime = time.time() - starttime
+            buf += d
+            while '\n' in buf:
+                line, buf = buf.split('\n', 1)
+                lines.append((curtime, line))
+                if endre.match(line):
+                    return lines
+    finally:
+        if p.poll() is None:
+            p.kill()
+        p.wait()
+
+# Find the start time (or index) of each phase from a list of
+# (position, line) pairs.
+def findPhases(lines):
+    phases = {}
+    for pos, line in lines:
+        for name, regex in PHASES:
+            if name not in phases and re.match(regex, line):
+                phases[name] = pos
+    return phases
+
+# Convert phase start positions into per-phase durations.
+def phaseDurations(starts):
+    res = {}
+    order = [name for name, regex in PHASES if name in starts]
+    for i in range(len(order) - 1):
+        res[order[i]] = starts[order[i+1]] - starts[order[i]]
+    if ENDMARKER in starts and 'post' in starts:
+        res['total'] = starts[ENDMARKER] - starts['post']
+    return res
+
+def median(vals):
+    vals = sorted(vals)
+    return vals[len(vals) / 2]
+
+# Time a configuration (median of several runs).
+def timeConfig(options, bios, extra):
+    endre = re.compile(dict(PHASES)[ENDMARKER])
+    runs = []
+    for i in range(options.runs):
+        lines = runBoot(qemuArgs(options, bios, extra), endre)
+        if lines is None:
+            return None
+        runs.append(phaseDurations(findPhases(lines)))
+    res = {}
+    for name in runs[0]:
+        res[name] = median([r.get(name, 0.) for r in runs])
+    return res
+
+# Matches qemu's "cpu_out addr 0x402(b) value 83" style trace lines.
+TRACERE = re.compile(r'cpu_(in|out) addr 0x([0-9a-fA-F]+)\S* value (\d+)')
+
+# Count port io accesses per phase using qemu's io trace events.
+def countConfigIO(options, bios, extra, tmpdir):
+    logname = os.path.join(tmpdir, 'trace.log')
+    args = qemuArgs(options, bios, extra) + [
+        '-D', logname, '-trace', 'enable=cpu_in', '-trace', 'enable=cpu_out']
+    endre = re.compile(dict(PHASES)[ENDMARKER])
+    if runBoot(args, endre) is None:
+        return None
+    # Rebuild the debug output from writes to the debug port and
+    # note the io access count at the start of each line.
+    count = 0
+    lines = []
+    cur = ''
+    for traceline in open(logname, 'rb'):
+        m = TRACERE.search(traceline)
+        if m is None:
+            continue
+        count += 1
+        dir, port, val = m.groups()
+        if dir != 'out' or int(port, 16) != 0x402:
+            continue
+        if not cur:
+            linestart = count
+        c = chr(int(val) & 0xff)
+        if c == '\n':
+            lines.append((linestart, cur))
+            cur = ''
+        else:
+            cur += c
+    os.unlink(logname)
+    return phaseDurations(findPhases(lines))
+
+
+######################################################################
+# Reporting
+######################################################################
+
+def compare(results, baseline, options):
+    regressions = []
+    for config, res in sorted(results.items()):
+        base = baseline.get(config)
+        if not base:
+            continue
+        for phase, vals in sorted(res.items()):
+            bvals = base.get(phase)
+            if not bvals:
+                continue
+            t, bt = vals.get('time'), bvals.get('time')
+            if t is not None and bt and t > bt * (1. + options.timetol):
+                regressions.append("%s/%s time %.3fs (baseline %.3fs)" % (
+                    config, phase, t, bt))
+            io, bio = vals.get('io'), bvals.get('io')
+            if io is not None and bio and io > bio * (1. + options.iotol):
+                regressions.append("%s/%s io %d (baseline %d)" % (
+                    config, phase, io, bio))
+    return regressions
+
+def report(results, baseline):
+    phasenames = [name for name, regex in PHASES] + ['total']
+    for config, res in sorted(results.items()):
+        sys.stdout.write("%s:\n" % (config,))
+        base = baseline.get(config, {})
+        for phase in phasenames:
+            vals = res.get(phase)
+            if vals is None:
+                continue
+            bvals = base.get(phase, {})
+            out = "  %-12s %8.3fs" % (phase, vals.get('time', 0.))
+            if 'io' in vals:
+                out += " %9d io" % (vals['io'],)
+            if bvals.get('time'):
+                out += "  (%+.1f%%" % (
+                    (vals.get('time', 0.) / bvals['time'] - 1.) * 100.,)
+                if 'io' in vals and bvals.get('io'):
+                    out += " / %+d io" % (vals['io'] - bvals['io'],)
+                out += ")"
+            sys.stdout.write(out + "\n")
+
+
+######################################################################
+# Startup
+######################################################################
+
+def main():
+    opts = optparse.OptionParser("%prog [options] <bios.bin>")
+    opts.add_option("--qemu", default="qemu-system-x86_64",
+                    help="qemu binary to run")
+    opts.add_option("-c", "--config", action="append", default=[],
+                    help="configuration to run (default: all)")
+    opts.add_option("-n", "--runs", type="int", default=3,
+                    help="timing runs per configuration")
+    opts.add_option("--io", action="store_true",
+                    help="also count port io accesses (needs qemu tracing)")
+    opts.add_option("-m", "--memory", type="int", default=512,
+                    help="guest memory in MiB")
+    opts.add_option("--smp", type="int", default=1, help="guest cpus")
+    opts.add_option("-b", "--baseline", help="baseline file to compare to")
+    opts.add_option("-s", "--save", help="save results to this file")
+    opts.add_option("--timetol", type="float", default=TIMETOLERANCE,
+                    help="allowed fractional time increase")
+    opts.add_option("--iotol", type="float", default=IOTOLERANCE,
+                    help="allowed fractional io count increase")
+    opts.add_option("-l", "--list", action="store_true",
+                    help="list configurations")
+    options, args = opts.parse_args()
+    if options.list:
+        for name, func in CONFIGS:
+            sys.stdout.write("%s\n" % (name,))
+        return
+    if len(args) != 1:
+        opts.error("Incorrect arguments")
+    bios = args[0]
+
+    configs = CONFIGS
+    if options.config:
+        configs = [(n, f) for n, f in CONFIGS if n in options.config]
+        if len(configs) != len(options.config):
+            opts.error("Unknown configuration")
+
+    baseline = {}
+    if options.baseline:
+        baseline = json.load(open(options.baseline))
+
+    results = {}
+    tmpdir = tempfile.mkdtemp(prefix='bootbench')
+    try:
+        for name, func in configs:
+            sys.stderr.write("Running %s\n" % (name,))
+            extra = func(tmpdir)
+            times = timeConfig(options, bios, extra)
+            if times is None:
+                sys.stderr.write("Config %s failed to boot\n" % (name,))
+                sys.exit(2)
+            res = dict([(phase, {'time': t}) for phase, t in times.items()])
+            if options.io:
+                ios = countConfigIO(options, bios, extra, tmpdir)
+                if ios is None:
+                    sys.stderr.write("Config %s failed io count\n" % (name,))
+                    sys.exit(2)
+                for phase, io in ios.items():
+                    res.setdefault(phase, {})['io'] = io
+            results[name] = res
+    finally:
+        shutil.rmtree(tmpdir)
+
+    report(results, baseline)
+    if options.save:
+        f = open(options.save, 'wb')
+        json.dump(results, f, indent=1, sort_keys=True)
+        f.close()
+    regressions = compare(results, baseline, options)
+    if regressions:
+        sys.stdout.write("\nRegressions:\n")
+        for r in regressions:
+            sys.stdout.write("  %s\n" % (r,))
+        sys.exit(1)
+
+if __name__ == '__main__':
+    main()
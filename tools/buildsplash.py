@@ -0,0 +1,122 @@
+#!/usr/bin/env python
+# Convert a 24bpp BMP image into a framebuffer native "bootsplash.raw".
+#
+# Copyright (C) 2026  the SeaBIOS developers <seabios@seabios.org>
+#
+# This file may be distributed under the terms of the GNU GPLv3 license.
+
+# The output image is scaled to the requested resolution, converted
+# to the pixel layout of the target vesa mode, and lzma compressed.
+# The bios can then uncompress it directly into the framebuffer.
+
+import sys
+import struct
+import subprocess
+import optparse
+
+RAW_SPLASH_MAGIC = 0x5a4c5053
+
+# Pixel layouts: (bpp, red size, red pos, green size, green pos,
+#                 blue size, blue pos)
+LAYOUTS = {
+    15: (15, 5, 10, 5, 5, 5, 0),
+    16: (16, 5, 11, 6, 5, 5, 0),
+    24: (24, 8, 16, 8, 8, 8, 0),
+    32: (32, 8, 16, 8, 8, 8, 0),
+    }
+
+# Read a 24bpp BMP file and return (width, height, rows) where each
+# row is a list of (r, g, b) tuples ordered top to bottom.
+def readBMP(filename):
+    data = open(filename, 'rb').read()
+    if data[:2] != 'BM':
+        raise ValueError("%s is not a BMP file" % (filename,))
+    offset, = struct.unpack('<I', data[10:14])
+    width, height, planes, bpp = struct.unpack('<iiHH', data[18:30])
+    if bpp != 24:
+        raise ValueError("Only 24bpp BMP files are supported")
+    bottomup = height > 0
+    height = abs(height)
+    stride = (width * 3 + 3) & ~3
+    rows = []
+    for y in range(height):
+        pos = offset + y * stride
+        row = []
+        for x in range(width):
+            b, g, r = map(ord, data[pos + x*3:pos + x*3 + 3])
+            row.append((r, g, b))
+        rows.append(row)
+    if bottomup:
+        rows.reverse()
+    return width, height, rows
+
+# Nearest neighbor scaling.
+def scale(width, height, rows, newwidth, newheight):
+    out = []
+    for y in range(newheight):
+        row = rows[y * height / newheight]
+        out.append([row[x * width / newwidth] for x in range(newwidth)])
+    return out
+
+def encodePixel(rgb, layout):
+    bpp, rs, rp, gs, gp, bs, bp = layout
+    r, g, b = rgb
+    val = (((r >> (8-rs)) << rp) | ((g >> (8-gs)) << gp)
+           | ((b >> (8-bs)) << bp))
+    if bpp == 24:
+        return struct.pack('<I', val)[:3]
+    if bpp == 32:
+        return struct.pack('<I', val)
+    return struct.pack('<H', val)
+
+def main():
+    opts = optparse.OptionParser("%prog [options] <in.bmp> <out.raw>")
+    opts.add_option("-W", "--width", type="int", help="target width")
+    opts.add_option("-H", "--height", type="int", help="target height")
+    opts.add_option("-b", "--bpp", type="int", default=32,
+                    help="target bits per pixel (15, 16, 24, or 32)")
+    opts.add_option("-p", "--pitch", type="int", default=0,
+                    help="target bytes per scanline (default: packed)")
+    options, args = opts.parse_args()
+    if len(args) != 2 or options.bpp not in LAYOUTS:
+        opts.error("Incorrect arguments")
+    inname, outname = args
+
+    width, height, rows = readBMP(inname)
+    newwidth = options.width or width
+    newheight = options.height or height
+    if (newwidth, newheight) != (width, height):
+        rows = scale(width, height, rows, newwidth, newheight)
+    layout = LAYOUTS[options.bpp]
+    bytesperpixel = (options.bpp + 7) / 8
+    pitch = options.pitch or newwidth * bytesperpixel
+    if pitch < newwidth * bytesperpixel:
+        opts.error("Pitch too small for width")
+
+    # Convert pixels to framebuffer format.
+    pad = "\0" * (pitch - newwidth * bytesperpixel)
+    pixels = "".join(["".join([encodePixel(p, layout) for p in row]) + pad
+                      for row in rows])
+
+    # Compress using the standard lzma tool (same as coreboot's cbfstool).
+    p = subprocess.Popen(["lzma", "-c", "-9"], stdin=subprocess.PIPE,
+                         stdout=subprocess.PIPE)
+    compressed, err = p.communicate(pixels)
+    if p.returncode:
+        sys.stderr.write("lzma failed\n")
+        sys.exit(1)
+    # lzma doesn't know the size when reading from a pipe - fill it in.
+    compressed = (compressed[:5] + struct.pack('<Q', len(pixels))
+                  + compressed[13:])
+
+    header = struct.pack('<IHHI8B', RAW_SPLASH_MAGIC, newwidth, newheight,
+                         pitch, *(layout + (0,)))
+    f = open(outname, 'wb')
+    f.write(header + compressed)
+    f.close()
+    print "Wrote %dx%d %dbpp image (%d bytes, %d uncompressed)" % (
+        newwidth, newheight, options.bpp, len(header) + len(compressed),
+        len(pixels))
+
+if __name__ == '__main__':
+    main()
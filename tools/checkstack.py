@@ -8,15 +8,26 @@
 
 # Usage:
 #   objdump -m i386 -M i8086 -M suffix -d out/rom16.o | tools/checkstack.py
+#
+# In addition to stack usage, a summary is reported for the main
+# interrupt handlers: the call chain with the most instructions (a
+# static worst-case latency estimate), and the number of port io
+# instructions and loops reachable from the handler.  The summary can
+# be saved with "-s <file>" and later builds diffed with "-c <file>".
 
 import sys
 import re
+import optparse
+import json
 
 # Functions that change stacks
 STACKHOP = ['__send_disk_op']
 # List of functions we can assume are never called.
 #IGNORE = ['panic', '__dprintf']
 IGNORE = ['panic']
+# Interrupt handlers to analyze by default.
+HANDLERS = ['handle_08', 'handle_09', 'handle_10', 'handle_13', 'handle_16'
+            , 'handle_1a', 'handle_74', 'handle_76']
 
 OUTPUTDESC = """
 #funcname1[preamble_stack_usage,max_usage_with_callers]:
@@ -113,12 +124,15 @@ re_asm = re.compile(
     + r') <(?P<ref>.*)>)?$')
 re_usestack = re.compile(
     r'^(push[f]?[lw])|(sub.* [$](?P<num>0x' + hex_s + r'),%esp)$')
+re_io = re.compile(r'^(rep[a-z]* )?(in|out|ins|outs)[bwl]?( |$)')
+re_loop = re.compile(r'^(rep[a-z]* |loop)')
 
 def calc():
     # funcs[funcaddr] = [funcname, basicstackusage, maxstackusage
     #                    , yieldusage, maxyieldusage, totalcalls
     #                    , [(insnaddr, calladdr, stackusage), ...]]
-    funcs = {-1: ['<indirect>', 0, 0, None, None, 0, []]}
+    #                    , insncount, iocount, loopcount]
+    funcs = {-1: ['<indirect>', 0, 0, None, None, 0, [], 0, 0, 0]}
     cur = None
     atstart = 0
     stackusage = 0
@@ -129,7 +143,8 @@ def calc():
         if m is not None:
             # Found function
             funcaddr = int(m.group('funcaddr'), 16)
-            funcs[funcaddr] = cur = [m.group('func'), 0, None, None, None, 0, []]
+            funcs[funcaddr] = cur = [m.group('func'), 0, None, None, None, 0, []
+                                     , 0, 0, 0]
             stackusage = 0
             atstart = 1
             subfuncs = {}
@@ -137,6 +152,11 @@ def calc():
         m = re_asm.match(line)
         if m is not None:
             insn = m.group('insn')
+            cur[7] += 1
+            if re_io.match(insn):
+                cur[8] += 1
+            if re_loop.match(insn):
+                cur[9] += 1
 
             im = re_usestack.match(insn)
             if im is not None:
@@ -175,7 +195,11 @@ def calc():
                 ref = m.group('ref')
                 if '+' in ref:
                     # Inter-function jump.
-                    pass
+                    if (calladdr <= int(insnaddr, 16)
+                        and not insn.startswith('loop')):
+                        # Backwards jump - a loop (loop insns are
+                        # already counted above).
+                        cur[9] += 1
                 elif insn.startswith('j'):
                     # Tail call
                     noteCall(cur, subfuncs, insnaddr, calladdr, 0)
@@ -195,6 +219,9 @@ def calc():
             continue
         calcmaxstack(funcs, funcaddr)
 
+    return funcs
+
+def printstack(funcs):
     # Sort functions for output
     funcaddrs = orderfuncs(funcs.keys(), funcs.copy())
 
@@ -202,7 +229,7 @@ def calc():
     print OUTPUTDESC
     for funcaddr in funcaddrs:
         name, basicusage, maxusage, yieldusage, maxyieldusage, count, calls = \
-            funcs[funcaddr]
+            funcs[funcaddr][:7]
         if maxusage == 0 and maxyieldusage is None:
             continue
         yieldstr = ""
@@ -218,8 +245,108 @@ def calc():
                 insnaddr, callinfo[0], stackusage, callinfo[1]
                 , stackusage+callinfo[2], yieldstr)
 
+# Find the call chain from a function with the most instructions.
+# Returns (insncount, [funcaddr, ...]).
+def calcchain(funcs, funcaddr, memo, visiting):
+    if funcaddr in memo:
+        return memo[funcaddr]
+    info = funcs[funcaddr]
+    best = (0, [])
+    visiting[funcaddr] = 1
+    for insnaddr, calladdr, usage in info[6]:
+        if calladdr not in funcs or calladdr in visiting:
+            continue
+        if funcs[calladdr][0].split('.')[0] in IGNORE:
+            continue
+        sub = calcchain(funcs, calladdr, memo, visiting)
+        if sub[0] > best[0]:
+            best = sub
+    del visiting[funcaddr]
+    res = (info[7] + best[0], [funcaddr] + best[1])
+    memo[funcaddr] = res
+    return res
+
+# Find all functions reachable from a function.
+def reachable(funcs, funcaddr, seen):
+    if funcaddr in seen or funcaddr not in funcs:
+        return seen
+    seen[funcaddr] = 1
+    for insnaddr, calladdr, usage in funcs[funcaddr][6]:
+        callinfo = funcs.get(calladdr)
+        if callinfo is not None and callinfo[0].split('.')[0] not in IGNORE:
+            reachable(funcs, calladdr, seen)
+    return seen
+
+# Calculate summary info for the given interrupt handlers.
+def analyze(funcs, handlers):
+    byname = {}
+    for funcaddr, info in funcs.items():
+        byname[info[0]] = funcaddr
+    res = {}
+    memo = {}
+    for name in handlers:
+        funcaddr = byname.get(name)
+        if funcaddr is None:
+            continue
+        insns, chain = calcchain(funcs, funcaddr, memo, {})
+        seen = reachable(funcs, funcaddr, {})
+        info = funcs[funcaddr]
+        res[name] = {
+            'stack': info[2],
+            'chaininsns': insns,
+            'chaindepth': len(chain),
+            'chain': [funcs[a][0] for a in chain],
+            'funcs': len(seen),
+            'io': sum([funcs[a][8] for a in seen]),
+            'loops': sum([funcs[a][9] for a in seen]),
+            'indirect': -1 in seen,
+            }
+    return res
+
+STATS = ['stack', 'chaininsns', 'chaindepth', 'funcs', 'io', 'loops']
+
+def printanalysis(res, prev):
+    print "\n#handler[stack,chain_insns,chain_depth,funcs,io_insns,loops]:"
+    print "#    longest chain"
+    for name in sorted(res.keys()):
+        info = res[name]
+        print "\n%s[%s]%s:" % (
+            name, ",".join([str(info[s]) for s in STATS])
+            , info['indirect'] and " (has indirect calls)" or "")
+        print "    %s" % (" -> ".join(info['chain']),)
+        pinfo = prev.get(name)
+        if pinfo is None:
+            continue
+        diffs = ["%s %+d" % (s, info[s] - pinfo.get(s, 0))
+                 for s in STATS if info[s] != pinfo.get(s, 0)]
+        if diffs:
+            print "    changed: %s" % (", ".join(diffs),)
+    removed = [name for name in prev if name not in res]
+    if removed:
+        print "\nHandlers no longer present: %s" % (", ".join(removed),)
+
 def main():
-    calc()
+    opts = optparse.OptionParser("%prog [options] < objdump-output")
+    opts.add_option("-H", "--handler", action="append", default=[],
+                    help="handler to analyze (default: main irq handlers)")
+    opts.add_option("-s", "--save", help="save handler summary to file")
+    opts.add_option("-c", "--compare", help="diff against a saved summary")
+    opts.add_option("-q", "--quiet", action="store_true",
+                    help="only report the handler summary")
+    options, args = opts.parse_args()
+
+    funcs = calc()
+    if not options.quiet:
+        printstack(funcs)
+    res = analyze(funcs, options.handler or HANDLERS)
+    prev = {}
+    if options.compare:
+        prev = json.load(open(options.compare))
+    printanalysis(res, prev)
+    if options.save:
+        f = open(options.save, 'wb')
+        json.dump(res, f, indent=1, sort_keys=True)
+        f.close()
 
 if __name__ == '__main__':
     main()
@@ -0,0 +1,218 @@
+// Host side benchmark for the bios lzma decoder.
+//
+// Copyright (C) 2026  the SeaBIOS developers <seabios@seabios.org>
+//
+// This file may be distributed under the terms of the GNU LGPLv3 license.
+
+// Usage:
+//   gcc -O2 -o out/lzmabench tools/lzmabench.c
+//   out/lzmabench [-n iterations] <coreboot.rom | file.lzma> ...
+//
+// Each argument is either a coreboot rom image or a raw lzma stream
+// with its uncompressed size in the header (as stored in CBFS by
+// cbfstool).  Streams from the xz-utils "lzma" tool record an unknown
+// size and are rejected.  For rom images, every compressed CBFS
+// file (".lzma" suffix) and every compressed payload segment is
+// benchmarked.  The decoder is built from src/lzmadecode.c so results
+// track the code used by the bios.  A checksum of each decoded stream
+// is printed so the output of different decoder versions can be
+// compared.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../src/lzmadecode.c"
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t
+be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint32_t
+le32(const uint8_t *p)
+{
+    return ((uint32_t)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+static int Iterations;
+static double TotalTime;
+static uint64_t TotalIn, TotalOut;
+
+// Decode an lzma stream (properties, 64bit size, data) once.
+static int
+decode(const uint8_t *src, uint32_t srclen, uint8_t *dst, uint32_t dstlen
+       , CProb *probs)
+{
+    CLzmaDecoderState state;
+    if (LzmaDecodeProperties(&state.Properties, src, LZMA_PROPERTIES_SIZE))
+        return -1;
+    state.Probs = probs;
+    SizeT inProcessed, outProcessed;
+    int ret = LzmaDecode(&state, src + LZMA_PROPERTIES_SIZE + 8
+                         , srclen - LZMA_PROPERTIES_SIZE - 8
+                         , &inProcessed, dst, dstlen, &outProcessed);
+    if (ret || outProcessed != dstlen)
+        return -1;
+    return 0;
+}
+
+// Benchmark the decoding of one lzma stream.
+static void
+bench(const char *name, const uint8_t *src, uint32_t srclen)
+{
+    if (srclen < LZMA_PROPERTIES_SIZE + 8) {
+        printf("%-32s too short\n", name);
+        return;
+    }
+    CLzmaProperties props;
+    if (LzmaDecodeProperties(&props, src, LZMA_PROPERTIES_SIZE)) {
+        printf("%-32s bad properties\n", name);
+        return;
+    }
+    if (le32(src + LZMA_PROPERTIES_SIZE + 4)) {
+        // Also catches the 0xFFFFFFFFFFFFFFFF "unknown size" marker.
+        printf("%-32s unknown size - use cbfstool/known-size streams\n"
+               , name);
+        return;
+    }
+    uint32_t dstlen = le32(src + LZMA_PROPERTIES_SIZE);
+    uint8_t *dst = malloc((size_t)dstlen + 1);
+    CProb *probs = malloc(LzmaGetNumProbs(&props) * sizeof(CProb));
+    if (!dst || !probs) {
+        printf("%-32s out of memory\n", name);
+        exit(1);
+    }
+
+    int count = Iterations, i;
+    double start = now(), elapsed;
+    for (i=0; ; i++) {
+        if (decode(src, srclen, dst, dstlen, probs)) {
+            printf("%-32s decode error\n", name);
+            goto done;
+        }
+        elapsed = now() - start;
+        if (count ? i+1 >= count : elapsed >= 0.5)
+            break;
+    }
+    count = i+1;
+
+    uint32_t sum = 0, pos;
+    for (pos=0; pos<dstlen; pos++)
+        sum = (sum * 33) ^ dst[pos];
+    double per = elapsed / count;
+    printf("%-32s %8u -> %8u lc=%d lp=%d pb=%d %8.3fms %7.2fMB/s sum=%08x\n"
+           , name, srclen, dstlen, props.lc, props.lp, props.pb
+           , per * 1000, dstlen / per / (1024*1024), sum);
+    TotalTime += per;
+    TotalIn += srclen;
+    TotalOut += dstlen;
+done:
+    free(probs);
+    free(dst);
+}
+
+// Find and benchmark the compressed contents of a coreboot rom image.
+static int
+bench_cbfs(const char *fname, const uint8_t *rom, uint32_t size)
+{
+    if (size < 64)
+        return -1;
+    uint32_t hdrpos = le32(rom + size - 4) + size;
+    if (hdrpos + 32 > size || be32(rom + hdrpos) != 0x4F524243)
+        return -1;
+    uint32_t romsize = be32(rom + hdrpos + 8);
+    uint32_t align = be32(rom + hdrpos + 16);
+    uint32_t offset = be32(rom + hdrpos + 20);
+    if (romsize != size || !align)
+        return -1;
+
+    int found = 0;
+    uint32_t pos = offset;
+    while (pos + 24 <= size && memcmp(rom + pos, "LARCHIVE", 8) == 0) {
+        uint32_t len = be32(rom + pos + 8);
+        uint32_t type = be32(rom + pos + 12);
+        uint32_t dataoff = be32(rom + pos + 20);
+        const char *name = (const char *)rom + pos + 24;
+        const uint8_t *data = rom + pos + dataoff;
+        if (pos + dataoff + len > size)
+            break;
+        int namelen = strlen(name);
+        char desc[128];
+        if (namelen > 5 && strcmp(name + namelen - 5, ".lzma") == 0) {
+            snprintf(desc, sizeof(desc), "%s", name);
+            bench(desc, data, len);
+            found++;
+        } else if (type == 0x20) {
+            // Payload - benchmark each lzma compressed segment.
+            const uint8_t *seg = data;
+            int segnum = 0;
+            for (; seg + 28 <= data + len; seg += 28, segnum++) {
+                uint32_t segtype = le32(seg);
+                if (segtype == 0x52544E45) // ENTRY
+                    break;
+                if (be32(seg + 4) != 1) // Not lzma
+                    continue;
+                uint32_t segoff = be32(seg + 8), seglen = be32(seg + 20);
+                if (segoff + seglen > len)
+                    break;
+                snprintf(desc, sizeof(desc), "%s[%d]", name, segnum);
+                bench(desc, data + segoff, seglen);
+                found++;
+            }
+        }
+        pos = (pos + dataoff + len + align - 1) & ~(align - 1);
+    }
+    if (!found)
+        printf("%s: no compressed files found\n", fname);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int i;
+    for (i=1; i<argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i+1 < argc) {
+            Iterations = atoi(argv[++i]);
+            continue;
+        }
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            perror(argv[i]);
+            return 1;
+        }
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        if (size < 0) {
+            perror(argv[i]);
+            return 1;
+        }
+        uint8_t *data = malloc(size);
+        if (!data || fread(data, 1, size, f) != (size_t)size) {
+            fprintf(stderr, "Unable to read %s\n", argv[i]);
+            return 1;
+        }
+        fclose(f);
+        if (bench_cbfs(argv[i], data, size))
+            bench(argv[i], data, size);
+        free(data);
+    }
+    if (TotalTime)
+        printf("Total: %llu -> %llu bytes in %.3fms (%.2fMB/s)\n"
+               , (unsigned long long)TotalIn, (unsigned long long)TotalOut
+               , TotalTime * 1000, TotalOut / TotalTime / (1024*1024));
+    return 0;
+}
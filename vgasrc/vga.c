@@ -197,95 +197,146 @@ set_scan_lines(u8 lines)
  * Character writing
  ****************************************************************/
 
-// Scroll the screen one line.  This function is designed to be called
-// tail-recursive to reduce stack usage.
+// Scroll the screen up the given number of lines.  This function is
+// designed to be called tail-recursive to reduce stack usage.
 static void noinline
-scroll_one(u16 nbrows, u16 nbcols, u8 page)
+scroll_lines(u16 nblines, u16 nbrows, u16 nbcols, u8 page)
 {
     struct cursorpos ul = {0, 0, page};
     struct cursorpos lr = {nbcols-1, nbrows-1, page};
-    vgafb_scroll(1, -1, ul, lr);
+    vgafb_scroll(nblines, -1, ul, lr);
+}
+
+static inline int
+is_teletype_control(u8 car)
+{
+    return car == 7 || car == 8 || car == '\r' || car == '\n' || car == '\t';
+}
+
+// Determine the row the cursor will be on after writing a string
+// (which may be past the bottom of the screen).
+static int
+teletype_end_row(struct cursorpos cp, u16 nbcols, u16 count
+                 , u16 seg, u8 *str_far, int charsize)
+{
+    int x = cp.x, y = cp.y;
+    for (; count; count--, str_far += charsize) {
+        switch (GET_FARVAR(seg, *str_far)) {
+        case 7:
+            break;
+        case 8:
+            if (x > 0)
+                x--;
+            break;
+        case '\r':
+            x = 0;
+            break;
+        case '\n':
+            y++;
+            break;
+        case '\t':
+            x += 8 - x % 8;
+            if (x > nbcols)
+                x = nbcols;
+            break;
+        default:
+            x++;
+        }
+        if (x >= nbcols) {
+            x = 0;
+            y++;
+        }
+    }
+    return y;
 }
 
-// Write a character to the screen at a given position.  Implement
-// special characters and scroll the screen if necessary.
+static u8 TabSpaces[8] VAR16 = "        ";
+
+// Write a buffer of characters to the screen at a given position.
+// Implement special characters and scroll the screen if necessary.
+// If 'attrstr' is set the buffer contains alternating characters and
+// attributes.  The video mode is looked up once, runs of regular
+// characters are written with a single framebuffer call, and all
+// scrolling is performed up front in one pass.
 static void
-write_teletype(struct cursorpos *pcp, struct carattr ca)
+write_teletype(struct cursorpos *pcp, struct carattr ca, int attrstr
+               , u16 count, u16 seg, u8 *str_far)
 {
-    struct cursorpos cp = *pcp;
+    struct vgamode_s *vmode_g = find_vga_entry(GET_BDA(video_mode));
+    if (!vmode_g)
+        return;
 
     // Get the dimensions
     u16 nbrows = GET_BDA(video_rows) + 1;
     u16 nbcols = GET_BDA(video_cols);
+    int charsize = attrstr ? 2 : 1;
+    u8 page = pcp->page;
+
+    // Scroll once for all the lines the string will add - output that
+    // would be scrolled off the screen is then skipped.
+    int scroll = (teletype_end_row(*pcp, nbcols, count, seg, str_far, charsize)
+                  - (nbrows - 1));
+    if (scroll > 0)
+        scroll_lines(scroll > nbrows ? nbrows : scroll, nbrows, nbcols, page);
+    else
+        scroll = 0;
+
+    int x = pcp->x, y = pcp->y - scroll;
+    while (count) {
+        u8 car = GET_FARVAR(seg, *str_far);
+        if (attrstr)
+            ca.attr = GET_FARVAR(seg, str_far[1]);
+        u16 runlen = 1;
+        switch (car) {
+        case 7:
+            //FIXME should beep
+            break;
+        case 8:
+            if (x > 0)
+                x--;
+            break;
+        case '\r':
+            x = 0;
+            break;
+        case '\n':
+            y++;
+            break;
+        case '\t': {
+            u16 nbspaces = 8 - x % 8;
+            if (x + nbspaces > nbcols)
+                nbspaces = nbcols - x;
+            if (y >= 0) {
+                struct cursorpos cp = {x, y, page};
+                vgafb_write_string(vmode_g, cp, ca, 0, nbspaces
+                                   , get_global_seg(), TabSpaces);
+            }
+            x += nbspaces;
+            break;
+        }
+        default:
+            // Find the run of regular characters on this row.
+            while (runlen < count && x + runlen < nbcols
+                   && !is_teletype_control(
+                       GET_FARVAR(seg, str_far[runlen * charsize])))
+                runlen++;
+            if (y >= 0) {
+                struct cursorpos cp = {x, y, page};
+                vgafb_write_string(vmode_g, cp, ca, attrstr, runlen
+                                   , seg, str_far);
+            }
+            x += runlen;
+        }
+        str_far += runlen * charsize;
+        count -= runlen;
 
-    switch (ca.car) {
-    case 7:
-        //FIXME should beep
-        break;
-    case 8:
-        if (cp.x > 0)
-            cp.x--;
-        break;
-    case '\r':
-        cp.x = 0;
-        break;
-    case '\n':
-        cp.y++;
-        break;
-    case '\t':
-        do {
-            struct carattr dummyca = {' ', ca.attr, ca.use_attr};
-            vgafb_write_char(cp, dummyca);
-            cp.x++;
-        } while (cp.x < nbcols && cp.x % 8);
-        break;
-    default:
-        vgafb_write_char(cp, ca);
-        cp.x++;
-    }
-
-    // Do we need to wrap ?
-    if (cp.x == nbcols) {
-        cp.x = 0;
-        cp.y++;
-    }
-    // Do we need to scroll ?
-    if (cp.y < nbrows) {
-        *pcp = cp;
-        return;
+        // Do we need to wrap ?
+        if (x >= nbcols) {
+            x = 0;
+            y++;
+        }
     }
-    // Scroll screen
-    cp.y--;
+    struct cursorpos cp = {x, y, page};
     *pcp = cp;
-    scroll_one(nbrows, nbcols, cp.page);
-}
-
-// Write out a buffer of alternating characters and attributes.
-static void
-write_attr_string(struct cursorpos *pcp, u16 count, u16 seg, u8 *offset_far)
-{
-    while (count--) {
-        u8 car = GET_FARVAR(seg, *offset_far);
-        offset_far++;
-        u8 attr = GET_FARVAR(seg, *offset_far);
-        offset_far++;
-
-        struct carattr ca = {car, attr, 1};
-        write_teletype(pcp, ca);
-    }
-}
-
-// Write out a buffer of characters.
-static void
-write_string(struct cursorpos *pcp, u8 attr, u16 count, u16 seg, u8 *offset_far)
-{
-    while (count--) {
-        u8 car = GET_FARVAR(seg, *offset_far);
-        offset_far++;
-
-        struct carattr ca = {car, attr, 1};
-        write_teletype(pcp, ca);
-    }
 }
 
 
@@ -617,9 +668,10 @@ handle_100e(struct bregs *regs)
 {
     // Ralf Brown Interrupt list is WRONG on bh(page)
     // We do output only on the current page !
-    struct carattr ca = {regs->al, regs->bl, 0};
+    u8 car = regs->al;
+    struct carattr ca = {car, regs->bl, 0};
     struct cursorpos cp = get_cursor_pos(0xff);
-    write_teletype(&cp, ca);
+    write_teletype(&cp, ca, 0, 1, GET_SEG(SS), &car);
     set_cursor_pos(cp);
 }
 
@@ -1027,10 +1079,8 @@ handle_1013(struct bregs *regs)
     if (cp.y == 0xff)
         cp = get_cursor_pos(cp.page);
     u8 flag = regs->al;
-    if (flag & 2)
-        write_attr_string(&cp, regs->cx, regs->es, (void*)(regs->bp + 0));
-    else
-        write_string(&cp, regs->bl, regs->cx, regs->es, (void*)(regs->bp + 0));
+    struct carattr ca = {0, regs->bl, 1};
+    write_teletype(&cp, ca, flag & 2, regs->cx, regs->es, (void*)(regs->bp + 0));
 
     if (flag & 1)
         set_cursor_pos(cp);
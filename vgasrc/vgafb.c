@@ -103,6 +103,33 @@ scroll_cga(struct vgamode_s *vmode_g, int nblines, int attr
                   , stride, nblines * cheight / 2);
 }
 
+static void
+scroll_lin(struct vgamode_s *vmode_g, int nblines, int attr
+           , struct cursorpos ul, struct cursorpos lr)
+{
+    int cheight = 8;
+    int stride = GET_BDA(video_cols) * 8;
+    void *src_far, *dest_far;
+    if (nblines >= 0) {
+        dest_far = (void*)(ul.y * cheight * stride + ul.x * 8);
+        src_far = dest_far + nblines * cheight * stride;
+    } else {
+        // Scroll down - start at the last pixel line of the region.
+        nblines = -nblines;
+        dest_far = (void*)((lr.y * cheight + cheight - 1) * stride + ul.x * 8);
+        src_far = dest_far - nblines * cheight * stride;
+        stride = -stride;
+    }
+    int cols = (lr.x - ul.x + 1) * 8;
+    int rows = lr.y - ul.y + 1;
+    if (nblines < rows)
+        dest_far = memcpy_stride(SEG_GRAPH, dest_far, src_far, cols, stride
+                                 , (rows - nblines) * cheight);
+    if (attr < 0)
+        attr = 0;
+    memset_stride(SEG_GRAPH, dest_far, attr, cols, stride, nblines * cheight);
+}
+
 static void
 scroll_text(struct vgamode_s *vmode_g, int nblines, int attr
             , struct cursorpos ul, struct cursorpos lr)
@@ -154,6 +181,9 @@ vgafb_scroll(int nblines, int attr, struct cursorpos ul, struct cursorpos lr)
     case CGA:
         scroll_cga(vmode_g, nblines, attr, ul, lr);
         break;
+    case LINEAR8:
+        scroll_lin(vmode_g, nblines, attr, ul, lr);
+        break;
     default:
         dprintf(1, "Scroll in graphics mode\n");
     }
@@ -182,6 +212,15 @@ clear_screen(struct vgamode_s *vmode_g)
  * Read/write characters to screen
  ****************************************************************/
 
+// Read a byte of planar video memory to load the vga latches.  The
+// value is unused, so make sure the compiler can't drop the read.
+static inline void
+load_latches_pl4(u8 *addr_far)
+{
+    u8 data = GET_FARVAR(SEG_GRAPH, *addr_far);
+    asm volatile("" : : "r"(data));
+}
+
 static void
 write_gfx_char_pl4(struct vgamode_s *vmode_g
                    , struct cursorpos cp, struct carattr ca)
@@ -214,22 +253,28 @@ write_gfx_char_pl4(struct vgamode_s *vmode_g
     u8 i;
     for (i = 0; i < cheight; i++) {
         u8 *dest_far = (void*)(addr + i * nbcols);
-        u8 j;
-        for (j = 0; j < 8; j++) {
-            u8 mask = 0x80 >> j;
-            vgahw_grdc_write(0x08, mask);
-            GET_FARVAR(SEG_GRAPH, *dest_far);
-            if (GET_GLOBAL(fdata_g[src + i]) & mask)
-                SET_FARVAR(SEG_GRAPH, *dest_far, ca.attr & 0x0f);
-            else
-                SET_FARVAR(SEG_GRAPH, *dest_far, 0x00);
-        }
+        u8 fontline = GET_GLOBAL(fdata_g[src + i]);
+        // Write all foreground pixels and then all background pixels
+        // of the line with one store each.  Masked out bits come from
+        // the latches, so they must be reloaded before each store.
+        load_latches_pl4(dest_far);
+        vgahw_grdc_write(0x08, fontline);
+        SET_FARVAR(SEG_GRAPH, *dest_far, ca.attr & 0x0f);
+        load_latches_pl4(dest_far);
+        vgahw_grdc_write(0x08, ~fontline);
+        SET_FARVAR(SEG_GRAPH, *dest_far, 0x00);
     }
     vgahw_grdc_write(0x08, 0xff);
     vgahw_grdc_write(0x05, 0x00);
     vgahw_grdc_write(0x03, 0x00);
 }
 
+// Expand the bits of a nibble into 2bpp pixels.
+static u8 cga_expand2[16] VAR16 = {
+    0x00, 0x03, 0x0c, 0x0f, 0x30, 0x33, 0x3c, 0x3f,
+    0xc0, 0xc3, 0xcc, 0xcf, 0xf0, 0xf3, 0xfc, 0xff,
+};
+
 static void
 write_gfx_char_cga(struct vgamode_s *vmode_g
                    , struct cursorpos cp, struct carattr ca)
@@ -247,44 +292,33 @@ write_gfx_char_cga(struct vgamode_s *vmode_g
         u8 *dest_far = (void*)(addr + (i >> 1) * 80);
         if (i & 1)
             dest_far += 0x2000;
-        u8 mask = 0x80;
+        u8 fontline = GET_GLOBAL(fdata_g[src + i]);
         if (bpp == 1) {
-            u8 data = 0;
+            u8 data = (ca.attr & 0x01) ? fontline : 0x00;
             if (ca.attr & 0x80)
-                data = GET_FARVAR(SEG_CTEXT, *dest_far);
-            u8 j;
-            for (j = 0; j < 8; j++) {
-                if (GET_GLOBAL(fdata_g[src + i]) & mask) {
-                    if (ca.attr & 0x80)
-                        data ^= (ca.attr & 0x01) << (7 - j);
-                    else
-                        data |= (ca.attr & 0x01) << (7 - j);
-                }
-                mask >>= 1;
-            }
+                data ^= GET_FARVAR(SEG_CTEXT, *dest_far);
             SET_FARVAR(SEG_CTEXT, *dest_far, data);
         } else {
-            while (mask > 0) {
-                u8 data = 0;
-                if (ca.attr & 0x80)
-                    data = GET_FARVAR(SEG_CTEXT, *dest_far);
-                u8 j;
-                for (j = 0; j < 4; j++) {
-                    if (GET_GLOBAL(fdata_g[src + i]) & mask) {
-                        if (ca.attr & 0x80)
-                            data ^= (ca.attr & 0x03) << ((3 - j) * 2);
-                        else
-                            data |= (ca.attr & 0x03) << ((3 - j) * 2);
-                    }
-                    mask >>= 1;
-                }
-                SET_FARVAR(SEG_CTEXT, *dest_far, data);
-                dest_far += 1;
-            }
+            // Build both bytes of the line and store them at once.
+            u16 data = ((GET_GLOBAL(cga_expand2[fontline >> 4])
+                         | (GET_GLOBAL(cga_expand2[fontline & 0x0f]) << 8))
+                        & ((ca.attr & 0x03) * 0x5555));
+            u16 *dest16_far = (void*)dest_far;
+            if (ca.attr & 0x80)
+                data ^= GET_FARVAR(SEG_CTEXT, *dest16_far);
+            SET_FARVAR(SEG_CTEXT, *dest16_far, data);
         }
     }
 }
 
+// Expand the bits of a nibble into four 8bpp pixel masks.
+static u32 lin_expand8[16] VAR16 = {
+    0x00000000, 0xff000000, 0x00ff0000, 0xffff0000,
+    0x0000ff00, 0xff00ff00, 0x00ffff00, 0xffffff00,
+    0x000000ff, 0xff0000ff, 0x00ff00ff, 0xffff00ff,
+    0x0000ffff, 0xff00ffff, 0x00ffffff, 0xffffffff,
+};
+
 static void
 write_gfx_char_lin(struct vgamode_s *vmode_g
                    , struct cursorpos cp, struct carattr ca)
@@ -297,18 +331,16 @@ write_gfx_char_lin(struct vgamode_s *vmode_g
     u8 *fdata_g = vgafont8;
     u16 addr = cp.x * 8 + cp.y * nbcols * 64;
     u16 src = ca.car * 8;
+    u32 color = ca.attr * 0x01010101;
     u8 i;
     for (i = 0; i < 8; i++) {
-        u8 *dest_far = (void*)(addr + i * nbcols * 8);
-        u8 mask = 0x80;
-        u8 j;
-        for (j = 0; j < 8; j++) {
-            u8 data = 0x00;
-            if (GET_GLOBAL(fdata_g[src + i]) & mask)
-                data = ca.attr;
-            SET_FARVAR(SEG_GRAPH, dest_far[j], data);
-            mask >>= 1;
-        }
+        u32 *dest_far = (void*)(addr + i * nbcols * 8);
+        u8 fontline = GET_GLOBAL(fdata_g[src + i]);
+        // Write the eight pixels of the line with two 32bit stores.
+        SET_FARVAR(SEG_GRAPH, dest_far[0]
+                   , GET_GLOBAL(lin_expand8[fontline >> 4]) & color);
+        SET_FARVAR(SEG_GRAPH, dest_far[1]
+                   , GET_GLOBAL(lin_expand8[fontline & 0x0f]) & color);
     }
 }
 
@@ -332,14 +364,9 @@ write_text_char(struct vgamode_s *vmode_g
     }
 }
 
-void
-vgafb_write_char(struct cursorpos cp, struct carattr ca)
+static void
+write_char(struct vgamode_s *vmode_g, struct cursorpos cp, struct carattr ca)
 {
-    // Get the mode
-    struct vgamode_s *vmode_g = find_vga_entry(GET_BDA(video_mode));
-    if (!vmode_g)
-        return;
-
     // FIXME gfx mode not complete
     switch (GET_GLOBAL(vmode_g->memmodel)) {
     case CTEXT:
@@ -359,6 +386,62 @@ vgafb_write_char(struct cursorpos cp, struct carattr ca)
     }
 }
 
+void
+vgafb_write_char(struct cursorpos cp, struct carattr ca)
+{
+    // Get the mode
+    struct vgamode_s *vmode_g = find_vga_entry(GET_BDA(video_mode));
+    if (!vmode_g)
+        return;
+
+    write_char(vmode_g, cp, ca);
+}
+
+// Write a run of characters that all fit on one row of the screen.
+// If 'attrstr' is set, the buffer at seg:str_far contains alternating
+// characters and attributes; otherwise the attribute in 'ca' is used.
+void
+vgafb_write_string(struct vgamode_s *vmode_g, struct cursorpos cp
+                   , struct carattr ca, int attrstr
+                   , u16 count, u16 seg, u8 *str_far)
+{
+    if (!(GET_GLOBAL(vmode_g->memmodel) & TEXT)) {
+        for (; count; count--, cp.x++) {
+            ca.car = GET_FARVAR(seg, *str_far);
+            str_far++;
+            if (attrstr) {
+                ca.attr = GET_FARVAR(seg, *str_far);
+                str_far++;
+            }
+            write_char(vmode_g, cp, ca);
+        }
+        return;
+    }
+
+    // Get the dimensions
+    u16 nbrows = GET_BDA(video_rows) + 1;
+    u16 nbcols = GET_BDA(video_cols);
+
+    // Compute the address
+    u16 *address_far = (void*)(SCREEN_MEM_START(nbcols, nbrows, cp.page)
+                               + (cp.x + cp.y * nbcols) * 2);
+    u16 vseg = GET_GLOBAL(vmode_g->sstart);
+
+    if (attrstr) {
+        // Buffer is already in framebuffer layout.
+        memcpy_far(vseg, address_far, seg, str_far, count * 2);
+        return;
+    }
+    if (ca.use_attr) {
+        u16 attr = ca.attr << 8;
+        for (; count; count--, address_far++, str_far++)
+            SET_FARVAR(vseg, *address_far, attr | GET_FARVAR(seg, *str_far));
+        return;
+    }
+    for (; count; count--, address_far++, str_far++)
+        SET_FARVAR(vseg, *(u8*)address_far, GET_FARVAR(seg, *str_far));
+}
+
 struct carattr
 vgafb_read_char(struct cursorpos cp)
 {
@@ -162,6 +162,9 @@ void clear_screen(struct vgamode_s *vmode_g);
 void vgafb_scroll(int nblines, int attr
                   , struct cursorpos ul, struct cursorpos lr);
 void vgafb_write_char(struct cursorpos cp, struct carattr ca);
+void vgafb_write_string(struct vgamode_s *vmode_g, struct cursorpos cp
+                        , struct carattr ca, int attrstr
+                        , u16 count, u16 seg, u8 *str_far);
 struct carattr vgafb_read_char(struct cursorpos cp);
 void vgafb_write_pixel(u8 color, u16 x, u16 y);
 u8 vgafb_read_pixel(u16 x, u16 y);